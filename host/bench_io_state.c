@@ -0,0 +1,116 @@
+// Lookup and snapshot cost of the io_state core: the pin slot table and
+// seqlock masks against the old linear entry array copied under s_lock.
+// Single thread, so the numbers are the uncontended fast paths.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "uwl_io_state.h"
+#include "uwl_io_state_old.h"
+#include "uwl_pin_table.h"
+
+#define BENCH_ITERS 2000000
+#define BENCH_ROUNDS 5
+
+static volatile uint32_t s_sink;
+
+static const uwl_io_entry_t s_table[UWL_PIN_TABLE_COUNT] = { UWL_PIN_TABLE_ENTRIES };
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+typedef uint32_t (*bench_fn)(const int *pins, size_t n_pins, size_t iters);
+
+// Best of BENCH_ROUNDS, in ns per call
+static double bench_run(bench_fn fn, const int *pins, size_t n_pins)
+{
+    double best = 0;
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        const double t0 = bench_now_ns();
+        s_sink += fn(pins, n_pins, BENCH_ITERS);
+        const double ns = (bench_now_ns() - t0) / BENCH_ITERS;
+        if (r == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+static uint32_t bench_get_old(const int *pins, size_t n_pins, size_t iters)
+{
+    uint32_t acc = 0;
+    for (size_t i = 0; i < iters; i++) {
+        uint8_t v = 0;
+        acc += (uint32_t)uwl_old_io_state_get(pins[i % n_pins], &v) + v;
+    }
+    return acc;
+}
+
+static uint32_t bench_get_new(const int *pins, size_t n_pins, size_t iters)
+{
+    uint32_t acc = 0;
+    for (size_t i = 0; i < iters; i++) {
+        uint8_t v = 0;
+        acc += (uint32_t)uwl_io_state_get(pins[i % n_pins], &v) + v;
+    }
+    return acc;
+}
+
+static uint32_t bench_snapshot_old(const int *pins, size_t n_pins, size_t iters)
+{
+    (void)pins;
+    (void)n_pins;
+    uwl_old_io_entry_t entries[32];
+    uint32_t acc = 0;
+    for (size_t i = 0; i < iters; i++) {
+        const size_t n = uwl_old_io_state_snapshot(entries, 32);
+        acc += entries[i % n].value;
+    }
+    return acc;
+}
+
+static uint32_t bench_snapshot_new(const int *pins, size_t n_pins, size_t iters)
+{
+    (void)pins;
+    (void)n_pins;
+    uint32_t acc = 0;
+    for (size_t i = 0; i < iters; i++) {
+        uwl_io_snapshot_t snap;
+        uwl_io_state_snapshot(&snap);
+        acc += snap.level_mask + snap.gen;
+    }
+    return acc;
+}
+
+static void bench_report(const char *what, bench_fn old_fn, bench_fn new_fn, const int *pins, size_t n_pins)
+{
+    const double o = bench_run(old_fn, pins, n_pins);
+    const double n = bench_run(new_fn, pins, n_pins);
+    printf("%-28s %8.2f %8.2f %7.1fx\n", what, o, n, n > 0 ? o / n : 0);
+}
+
+int main(void)
+{
+    if (uwl_old_io_state_init() != ESP_OK) return 1;
+
+    int hit[UWL_PIN_TABLE_COUNT];
+    for (size_t i = 0; i < UWL_PIN_TABLE_COUNT; i++) hit[i] = s_table[i].pin;
+    // Every GPIO number, whitelisted or not: a miss walks the whole old array
+    int any[31];
+    for (int i = 0; i < 31; i++) any[i] = i;
+    // The last table entry: worst case for the linear search
+    const int last = s_table[UWL_PIN_TABLE_COUNT - 1].pin;
+
+    printf("io_state core, %u whitelisted pins, %d calls x best of %d\n", (unsigned)UWL_PIN_TABLE_COUNT, BENCH_ITERS,
+           BENCH_ROUNDS);
+    printf("%-28s %8s %8s %8s\n", "ns/call", "old", "new", "speedup");
+    bench_report("get, whitelisted pins", bench_get_old, bench_get_new, hit, UWL_PIN_TABLE_COUNT);
+    bench_report("get, last table entry", bench_get_old, bench_get_new, &last, 1);
+    bench_report("get, GPIO 0..30", bench_get_old, bench_get_new, any, 31);
+    bench_report("consistent snapshot", bench_snapshot_old, bench_snapshot_new, hit, 1);
+    return s_sink == 0xdeadbeef;
+}
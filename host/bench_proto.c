@@ -0,0 +1,205 @@
+// Encode/decode cost per message of the shared JSON codec (uwl_proto.c)
+// against the cJSON build/print/parse path WS and BLE used before it. The
+// cJSON side mirrors the old uwl_build_gpio_changed_json /
+// uwl_build_gpio_changed_batch_json / uwl_json_get_*2 helpers and is only
+// built when cJSON sources are found (UWL_CJSON_DIR, default from IDF_PATH).
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "uwl_io_state.h"
+#include "uwl_proto.h"
+
+#if UWL_BENCH_CJSON
+#include "cJSON.h"
+#endif
+
+#define BENCH_ITERS 500000
+#define BENCH_ROUNDS 5
+
+static volatile uint32_t s_sink;
+static char s_buf[UWL_PROTO_STATE_BUF_LEN];
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+typedef uint32_t (*bench_fn)(const void *arg);
+
+// Best of BENCH_ROUNDS, in ns per message
+static double bench_run(bench_fn fn, const void *arg)
+{
+    double best = 0;
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        uint32_t acc = 0;
+        const double t0 = bench_now_ns();
+        for (int i = 0; i < BENCH_ITERS; i++) acc += fn(arg);
+        const double ns = (bench_now_ns() - t0) / BENCH_ITERS;
+        s_sink += acc;
+        if (r == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+typedef struct {
+    const uwl_io_event_t *evts;
+    size_t count;
+} bench_evts_t;
+
+static uint32_t bench_encode_new(const void *arg)
+{
+    const bench_evts_t *b = arg;
+    size_t used = 0;
+    return (uint32_t)uwl_proto_encode_changed(s_buf, sizeof(s_buf), b->evts, b->count, UINT32_MAX, &used);
+}
+
+static uint32_t bench_decode_new(const void *arg)
+{
+    const char *json = arg;
+    uwl_proto_cmd_t cmd;
+    if (uwl_proto_parse_cmd(json, strlen(json), &cmd) != ESP_OK) return 0;
+    return (uint32_t)uwl_proto_get_int(&cmd, UWL_PROTO_F_ID, -1) + (uint32_t)uwl_proto_get_int(&cmd, UWL_PROTO_F_PIN, -1) +
+           uwl_proto_get_u32(&cmd, UWL_PROTO_F_MASK, 0) + uwl_proto_get_u32(&cmd, UWL_PROTO_F_VALUE, 0) +
+           (uint32_t)cmd.type[0];
+}
+
+#if UWL_BENCH_CJSON
+static void bench_cjson_change(cJSON *o, const uwl_io_event_t *evt, int pin)
+{
+    cJSON_AddNumberToObject(o, "pin", pin);
+    cJSON_AddNumberToObject(o, "value", (evt->values >> pin) & 1U);
+    cJSON_AddStringToObject(o, "dir", evt->dir == UWL_IO_DIR_OUTPUT ? "out" : "in");
+}
+
+static uint32_t bench_encode_cjson(const void *arg)
+{
+    const bench_evts_t *b = arg;
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "type", "gpio_changed");
+    if (b->count == 1) {
+        const uwl_io_event_t *evt = &b->evts[0];
+        if (uwl_io_event_is_multi(evt)) {
+            cJSON_AddNumberToObject(root, "mask", evt->mask);
+            cJSON_AddNumberToObject(root, "values", evt->values);
+            cJSON *arr = cJSON_AddArrayToObject(root, "changes");
+            for (uint32_t m = evt->mask; m; m &= m - 1U) {
+                cJSON *o = cJSON_CreateObject();
+                bench_cjson_change(o, evt, __builtin_ctz(m));
+                cJSON_AddItemToArray(arr, o);
+            }
+        } else {
+            bench_cjson_change(root, evt, evt->pin);
+        }
+        cJSON_AddStringToObject(root, "reason", uwl_io_reason_name(evt->reason));
+        cJSON_AddNumberToObject(root, "seq", evt->seq);
+        cJSON_AddNumberToObject(root, "ts", (double)evt->ts_us);
+    } else {
+        cJSON *arr = cJSON_AddArrayToObject(root, "changes");
+        for (size_t i = 0; i < b->count; i++) {
+            const uwl_io_event_t *evt = &b->evts[i];
+            for (uint32_t m = evt->mask; m; m &= m - 1U) {
+                cJSON *o = cJSON_CreateObject();
+                bench_cjson_change(o, evt, __builtin_ctz(m));
+                cJSON_AddStringToObject(o, "reason", uwl_io_reason_name(evt->reason));
+                cJSON_AddNumberToObject(o, "seq", evt->seq);
+                cJSON_AddNumberToObject(o, "ts", (double)evt->ts_us);
+                cJSON_AddItemToArray(arr, o);
+            }
+        }
+    }
+    char *s = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    const uint32_t n = s ? (uint32_t)strlen(s) : 0;
+    cJSON_free(s);
+    return n;
+}
+
+static const cJSON *bench_cjson_get2(const cJSON *root, const char *k1, const char *k2)
+{
+    const cJSON *a = cJSON_GetObjectItemCaseSensitive(root, k1);
+    return a ? a : cJSON_GetObjectItemCaseSensitive(root, k2);
+}
+
+static uint32_t bench_decode_cjson(const void *arg)
+{
+    cJSON *root = cJSON_Parse((const char *)arg);
+    if (!root) return 0;
+    uint32_t acc = 0;
+    const cJSON *t = bench_cjson_get2(root, "type", "t");
+    if (cJSON_IsString(t) && t->valuestring) acc += (uint32_t)t->valuestring[0];
+    const char *const keys[][2] = { { "id", "i" }, { "pin", "p" }, { "mask", "m" }, { "values", "v" } };
+    for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+        const cJSON *v = bench_cjson_get2(root, keys[k][0], keys[k][1]);
+        if (cJSON_IsNumber(v) && v->valuedouble >= 0) acc += (uint32_t)v->valuedouble;
+    }
+    cJSON_Delete(root);
+    return acc;
+}
+#endif
+
+static void bench_report(const char *what, bench_fn new_fn, bench_fn cjson_fn, const void *arg)
+{
+    if (new_fn(arg) == 0) {
+        printf("%-34s failed\n", what);
+        return;
+    }
+    const double n = bench_run(new_fn, arg);
+#if UWL_BENCH_CJSON
+    const double c = bench_run(cjson_fn, arg);
+    printf("%-34s %8.1f %8.1f %7.1fx\n", what, c, n, n > 0 ? c / n : 0);
+#else
+    (void)cjson_fn;
+    printf("%-34s %8s %8.1f\n", what, "-", n);
+#endif
+}
+
+#if !UWL_BENCH_CJSON
+#define bench_encode_cjson NULL
+#define bench_decode_cjson NULL
+#endif
+
+int main(void)
+{
+    const int64_t ts = 1234567890;
+    const uwl_io_event_t edge = {
+        .pin = 10, .value = 1, .dir = UWL_IO_DIR_INPUT, .reason = UWL_IO_REASON_INPUT_EDGE,
+        .source = UWL_IO_SOURCE_LOCAL, .mask = 1UL << 10, .values = 1UL << 10, .seq = 4711, .ts_us = ts,
+    };
+    const uwl_io_event_t multi = {
+        .pin = 18, .value = 1, .dir = UWL_IO_DIR_OUTPUT, .reason = UWL_IO_REASON_SET_CMD,
+        .source = UWL_IO_SOURCE_WIFI, .mask = 0xF << 18, .values = 0x5 << 18, .seq = 4712, .ts_us = ts,
+    };
+    uwl_io_event_t burst[8];
+    for (size_t i = 0; i < 8; i++) {
+        burst[i] = edge;
+        burst[i].value = (uint8_t)(i & 1U);
+        burst[i].values = (uint32_t)burst[i].value << edge.pin;
+        burst[i].seq = edge.seq + (uint32_t)i;
+    }
+    const bench_evts_t one = { &edge, 1 };
+    const bench_evts_t mask = { &multi, 1 };
+    const bench_evts_t batch = { burst, 8 };
+
+    // A case that fails to encode or parse would time the error path
+    if (bench_encode_new(&one) == 0 || bench_encode_new(&mask) == 0 || bench_encode_new(&batch) == 0) return 1;
+    if (uwl_proto_encode_changed(s_buf, sizeof(s_buf), &edge, 1, UINT32_MAX, &(size_t){ 0 }) > 0) {
+        printf("%s\n", s_buf);
+    }
+
+    printf("%d messages x best of %d\n", BENCH_ITERS, BENCH_ROUNDS);
+    printf("%-34s %8s %8s %8s\n", "ns/message", "cJSON", "proto", "speedup");
+    bench_report("encode gpio_changed, 1 pin", bench_encode_new, bench_encode_cjson, &one);
+    bench_report("encode gpio_changed, 4-pin mask", bench_encode_new, bench_encode_cjson, &mask);
+    bench_report("encode gpio_changed, 8-event batch", bench_encode_new, bench_encode_cjson, &batch);
+    bench_report("decode {\"t\":\"s\",\"i\":7,\"p\":18,\"v\":1}", bench_decode_new, bench_decode_cjson,
+                 "{\"t\":\"s\",\"i\":7,\"p\":18,\"v\":1}");
+    bench_report("decode gpio_set_mask (long keys)", bench_decode_new, bench_decode_cjson,
+                 "{\"type\":\"gpio_set_mask\",\"id\":12,\"mask\":786432,\"values\":262144}");
+    return s_sink == 0xdeadbeef;
+}
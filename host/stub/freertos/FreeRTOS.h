@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffU
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// Spinlock, as portMUX is on a multi-core target. The benchmarks are single
+// threaded, so this measures the uncontended cost only.
+typedef struct {
+    volatile uint32_t owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+
+static inline void portMUX_INITIALIZE(portMUX_TYPE *m)
+{
+    __atomic_store_n(&m->owner, 0, __ATOMIC_RELEASE);
+}
+
+static inline void portENTER_CRITICAL(portMUX_TYPE *m)
+{
+    while (__atomic_exchange_n(&m->owner, 1, __ATOMIC_ACQUIRE) != 0) {
+    }
+}
+
+static inline void portEXIT_CRITICAL(portMUX_TYPE *m)
+{
+    __atomic_store_n(&m->owner, 0, __ATOMIC_RELEASE);
+}
+
+#define portENTER_CRITICAL_ISR portENTER_CRITICAL
+#define portEXIT_CRITICAL_ISR portEXIT_CRITICAL
+#define portENTER_CRITICAL_SAFE portENTER_CRITICAL
+#define portEXIT_CRITICAL_SAFE portEXIT_CRITICAL
+#define portYIELD_FROM_ISR() ((void)0)
@@ -0,0 +1,175 @@
+// Host stand-ins for the IDF/FreeRTOS calls uwl_io_state.c and uwl_proto.c
+// make. Nothing here starts tasks or queues: the benchmarks call the state
+// and codec functions directly on the main thread.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "uwl_gpio.h"
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    static char s[16];
+    snprintf(s, sizeof(s), "0x%x", (unsigned)code);
+    return s;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t esp_random(void)
+{
+    return (uint32_t)rand();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    pthread_mutex_t *m = malloc(sizeof(*m));
+    if (m) pthread_mutex_init(m, NULL);
+    return m;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait)
+{
+    (void)wait;
+    return pthread_mutex_lock((pthread_mutex_t *)s) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    return pthread_mutex_unlock((pthread_mutex_t *)s) == 0 ? pdTRUE : pdFALSE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+    (void)len;
+    (void)item_size;
+    return NULL;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait)
+{
+    (void)q;
+    (void)item;
+    (void)wait;
+    return pdFALSE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken)
+{
+    (void)q;
+    (void)item;
+    if (woken) *woken = pdFALSE;
+    return pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait)
+{
+    (void)q;
+    (void)item;
+    (void)wait;
+    return pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    (void)q;
+    return 0;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *out)
+{
+    (void)fn;
+    (void)name;
+    (void)stack;
+    (void)arg;
+    (void)prio;
+    if (out) *out = NULL;
+    return pdFALSE;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    (void)task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    (void)task;
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    (void)clear;
+    (void)wait;
+    return 0;
+}
+
+// GPIO registers: outputs latch into a word, inputs read back low
+
+static uint32_t s_out_latch;
+
+esp_err_t uwl_gpio_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t uwl_gpio_config_output(int pin, uint8_t initial_value)
+{
+    return uwl_gpio_set_mask(initial_value ? 1UL << pin : 0, initial_value ? 0 : 1UL << pin);
+}
+
+esp_err_t uwl_gpio_config_input_with_isr(int pin, bool pullup, bool pulldown)
+{
+    (void)pin;
+    (void)pullup;
+    (void)pulldown;
+    return ESP_OK;
+}
+
+esp_err_t uwl_gpio_set_mask(uint32_t set_mask, uint32_t clear_mask)
+{
+    if (set_mask & clear_mask) return ESP_ERR_INVALID_ARG;
+    s_out_latch = (s_out_latch & ~clear_mask) | set_mask;
+    return ESP_OK;
+}
+
+esp_err_t uwl_gpio_get_level(int pin, uint8_t *value_out)
+{
+    if (!value_out) return ESP_ERR_INVALID_ARG;
+    *value_out = (uint8_t)((s_out_latch >> pin) & 1U);
+    return ESP_OK;
+}
+
+esp_err_t uwl_gpio_set_debounce(int pin, uint32_t window_us, uint8_t stable_count)
+{
+    (void)pin;
+    (void)window_us;
+    (void)stable_count;
+    return ESP_OK;
+}
+
+esp_err_t uwl_gpio_get_debounce(int pin, uwl_gpio_debounce_info_t *out)
+{
+    (void)pin;
+    if (!out) return ESP_ERR_INVALID_ARG;
+    memset(out, 0, sizeof(*out));
+    return ESP_OK;
+}
@@ -0,0 +1,60 @@
+#include "uwl_io_state_old.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "uwl_pin_table.h"
+
+static const uwl_io_entry_t s_table[UWL_PIN_TABLE_COUNT] = { UWL_PIN_TABLE_ENTRIES };
+
+static uwl_old_io_entry_t s_entries[32];
+static size_t s_entry_count = 0;
+static SemaphoreHandle_t s_lock = NULL;
+
+static int uwl_find_entry_idx(int pin)
+{
+    for (size_t i = 0; i < s_entry_count; i++) {
+        if (s_entries[i].pin == pin) return (int)i;
+    }
+    return -1;
+}
+
+esp_err_t uwl_old_io_state_init(void)
+{
+    if (s_lock) return ESP_OK;
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    for (size_t i = 0; i < UWL_PIN_TABLE_COUNT; i++) {
+        s_entries[s_entry_count++] = (uwl_old_io_entry_t){ .pin = s_table[i].pin, .dir = s_table[i].dir };
+    }
+    return ESP_OK;
+}
+
+esp_err_t uwl_old_io_state_get(int pin, uint8_t *value_out)
+{
+    if (!value_out) return ESP_ERR_INVALID_ARG;
+    const int idx = uwl_find_entry_idx(pin);
+    if (idx < 0) return ESP_ERR_NOT_FOUND;
+    *value_out = s_entries[idx].value;
+    return ESP_OK;
+}
+
+esp_err_t uwl_old_io_state_apply(int pin, uint8_t value)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const int idx = uwl_find_entry_idx(pin);
+    if (idx >= 0) s_entries[idx].value = value ? 1 : 0;
+    xSemaphoreGive(s_lock);
+    return idx >= 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+size_t uwl_old_io_state_snapshot(uwl_old_io_entry_t *out, size_t cap)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const size_t n = s_entry_count < cap ? s_entry_count : cap;
+    memcpy(out, s_entries, n * sizeof(*out));
+    xSemaphoreGive(s_lock);
+    return n;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "uwl_io_state.h"
+
+// The io_state core as it was before the pin slot table and seqlock masks:
+// a linear entry array searched per call, readers copying it under s_lock.
+// Kept only as the baseline for bench_io_state.
+
+typedef struct {
+    int pin;
+    uwl_io_dir_t dir;
+    uint8_t value;
+} uwl_old_io_entry_t;
+
+// Same pins, same order as the generated table
+esp_err_t uwl_old_io_state_init(void);
+esp_err_t uwl_old_io_state_get(int pin, uint8_t *value_out);
+// Cached level update as the old set path and dispatcher did it
+esp_err_t uwl_old_io_state_apply(int pin, uint8_t value);
+// Consistent copy of every entry; returns the count
+size_t uwl_old_io_state_snapshot(uwl_old_io_entry_t *out, size_t cap);
@@ -4,12 +4,14 @@
 
 #if defined(CONFIG_BT_NIMBLE_ENABLED) && CONFIG_BT_NIMBLE_ENABLED
 
-#include <string.h>
 #include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include "cJSON.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "host/ble_hs.h"
 #include "host/util/util.h"
@@ -19,9 +21,25 @@
 #include "services/gatt/ble_svc_gatt.h"
 
 #include "uwl_io_state.h"
+#include "uwl_lat.h"
+#include "uwl_proto.h"
+#include "uwl_rate.h"
+#include "uwl_status.h"
 
 static const char *TAG = "uwl_ble";
 
+#ifndef CONFIG_UWL_IO_HISTORY_LEN
+#define CONFIG_UWL_IO_HISTORY_LEN 64
+#endif
+#ifndef CONFIG_UWL_RATE_BLE_CLIENT_PER_S
+#define CONFIG_UWL_RATE_BLE_CLIENT_PER_S 30
+#endif
+#ifndef CONFIG_UWL_RATE_BLE_CLIENT_BURST
+#define CONFIG_UWL_RATE_BLE_CLIENT_BURST 10
+#endif
+// sync replies with per-pin deltas up to this many pins, else the bitmask form
+#define UWL_BLE_SYNC_MAX_PINS 4
+
 // 128-bit UUIDs (random)
 static const ble_uuid128_t UWL_SVC_UUID =
     BLE_UUID128_INIT(0x5f,0x2f,0x1a,0x35,0x0d,0x2f,0x4f,0x0c,0x9a,0x1c,0x38,0x48,0x72,0x3b,0x8e,0x10);
@@ -33,7 +51,18 @@ static const ble_uuid128_t UWL_STATE_UUID =
 static uint16_t s_state_chr_val_handle = 0;
 static uint16_t s_conn_handle = BLE_HS_CONN_HANDLE_NONE;
 static bool s_state_notify_enabled = false;
+// Pins the central wants pushes for ({"t":"sub"}); reset on every connection
+static uint32_t s_sub_mask = UINT32_MAX;
 static uint8_t s_own_addr_type = BLE_OWN_ADDR_PUBLIC;
+// CTRL write budget for the current connection (NimBLE host task only)
+static uwl_rate_bucket_t s_rx_rate;
+// CTRL writes are copied here (+ NUL); ATT caps an attribute value at 512 bytes
+#define UWL_BLE_RX_MAX_LEN 512
+static char s_rx_buf[UWL_BLE_RX_MAX_LEN + 1];
+// When the CTRL write being handled arrived, for latency accounting
+static int64_t s_rx_us = 0;
+static uint32_t s_rate_limited = 0;
+static uwl_ble_notify_stats_t s_notify_stats;
 
 static void uwl_ble_advertise_start(void);
 
@@ -47,40 +76,25 @@ bool uwl_ble_is_state_notify_enabled(void)
     return s_state_notify_enabled;
 }
 
-static char *uwl_build_state_json(void)
+uint32_t uwl_ble_get_rate_limited(void)
 {
-    size_t count = 0;
-    const uwl_io_entry_t *entries = uwl_io_state_entries(&count);
-
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "state");
-    cJSON *arr = cJSON_AddArrayToObject(root, "gpios");
-    for (size_t i = 0; i < count; i++) {
-        cJSON *o = cJSON_CreateObject();
-        cJSON_AddNumberToObject(o, "pin", entries[i].pin);
-        cJSON_AddStringToObject(o, "dir", entries[i].dir == UWL_IO_DIR_OUTPUT ? "out" : "in");
-        cJSON_AddNumberToObject(o, "value", entries[i].value ? 1 : 0);
-        cJSON_AddItemToArray(arr, o);
-    }
-    char *s = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    return s;
+    return __atomic_load_n(&s_rate_limited, __ATOMIC_RELAXED);
 }
 
-static char *uwl_build_gpio_changed_json(const uwl_io_event_t *evt)
+void uwl_ble_get_notify_stats(uwl_ble_notify_stats_t *out)
 {
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "gpio_changed");
-    cJSON_AddNumberToObject(root, "pin", evt->pin);
-    cJSON_AddNumberToObject(root, "value", evt->value ? 1 : 0);
-    cJSON_AddStringToObject(root, "dir", evt->dir == UWL_IO_DIR_OUTPUT ? "out" : "in");
-    cJSON_AddStringToObject(root, "reason", evt->reason == UWL_IO_REASON_INPUT_EDGE ? "edge" :
-                                        evt->reason == UWL_IO_REASON_SET_CMD ? "set" : "boot");
-    char *s = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    return s;
+    if (!out) return;
+    out->sent = __atomic_load_n(&s_notify_stats.sent, __ATOMIC_RELAXED);
+    out->failed = __atomic_load_n(&s_notify_stats.failed, __ATOMIC_RELAXED);
 }
 
+// Encode buffers, one per sending task: the io listener worker owns
+// s_evt_buf, the NimBLE host task (CTRL writes, STATE reads) owns s_host_buf.
+// ble_hs_mbuf_from_flat copies, so both are free again on return.
+static char s_evt_buf[UWL_PROTO_STATE_BUF_LEN];
+static char s_host_buf[UWL_PROTO_STATE_BUF_LEN];
+static uwl_io_event_t s_sync_evts[CONFIG_UWL_IO_HISTORY_LEN];
+
 static void uwl_ble_notify_text(const char *text)
 {
     if (!text) return;
@@ -88,19 +102,10 @@ static void uwl_ble_notify_text(const char *text)
     if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
     if (s_state_chr_val_handle == 0) return;
 
+    // notify_custom consumes om on success and failure alike
     struct os_mbuf *om = ble_hs_mbuf_from_flat(text, strlen(text));
-    if (!om) return;
-    (void)ble_gatts_notify_custom(s_conn_handle, s_state_chr_val_handle, om);
-}
-
-static const char *uwl_err_code_from_esp(esp_err_t e)
-{
-    if (e == ESP_OK) return "OK";
-    if (e == ESP_ERR_NOT_FOUND) return "NOT_FOUND";
-    if (e == ESP_ERR_INVALID_STATE) return "NOT_OUTPUT";
-    if (e == ESP_ERR_INVALID_ARG) return "BAD_ARG";
-    if (e == ESP_ERR_NO_MEM) return "NO_MEM";
-    return "FAIL";
+    const int rc = om ? ble_gatts_notify_custom(s_conn_handle, s_state_chr_val_handle, om) : BLE_HS_ENOMEM;
+    __atomic_fetch_add(rc == 0 ? &s_notify_stats.sent : &s_notify_stats.failed, 1U, __ATOMIC_RELAXED);
 }
 
 static const char *uwl_skip_ws(const char *s)
@@ -111,55 +116,29 @@ static const char *uwl_skip_ws(const char *s)
 
 static void uwl_ble_notify_err(int id, const char *code, const char *msg)
 {
-    cJSON *root = cJSON_CreateObject();
-    if (!root) return;
-    cJSON_AddStringToObject(root, "type", "err");
-    if (id >= 0) cJSON_AddNumberToObject(root, "id", id);
-    if (code) cJSON_AddStringToObject(root, "code", code);
-    if (msg) cJSON_AddStringToObject(root, "msg", msg);
-    char *s = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    if (s) {
-        uwl_ble_notify_text(s);
-        cJSON_free(s);
-    }
+    char buf[UWL_PROTO_SMALL_BUF_LEN];
+    if (uwl_proto_encode_err(buf, sizeof(buf), id, code, msg) > 0) uwl_ble_notify_text(buf);
 }
 
-static void uwl_ble_notify_resp_ok(int id, cJSON *data_opt)
+// Host task only: replies are built in s_host_buf
+static void uwl_ble_resp_begin(uwl_proto_writer_t *w, int id)
 {
-    cJSON *root = cJSON_CreateObject();
-    if (!root) {
-        if (data_opt) cJSON_Delete(data_opt);
-        return;
-    }
-    cJSON_AddStringToObject(root, "type", "resp");
-    if (id >= 0) cJSON_AddNumberToObject(root, "id", id);
-    cJSON_AddBoolToObject(root, "ok", true);
-    if (data_opt) cJSON_AddItemToObject(root, "data", data_opt);
-    char *s = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    if (s) {
-        uwl_ble_notify_text(s);
-        cJSON_free(s);
-    }
+    uwl_proto_writer_init(w, s_host_buf, sizeof(s_host_buf));
+    uwl_proto_resp_begin(w, id, true);
 }
 
-static const char *uwl_json_get_str2(const cJSON *root, const char *k1, const char *k2)
+static void uwl_ble_resp_send(uwl_proto_writer_t *w)
 {
-    const cJSON *a = cJSON_GetObjectItemCaseSensitive(root, k1);
-    if (cJSON_IsString(a) && a->valuestring) return a->valuestring;
-    const cJSON *b = cJSON_GetObjectItemCaseSensitive(root, k2);
-    if (cJSON_IsString(b) && b->valuestring) return b->valuestring;
-    return NULL;
+    if (uwl_proto_resp_end_us(w, true, esp_timer_get_time() - s_rx_us) > 0) uwl_ble_notify_text(s_host_buf);
 }
 
-static int uwl_json_get_i32_2(const cJSON *root, const char *k1, const char *k2, int defv)
+static void uwl_ble_notify_resp_ok(int id)
 {
-    const cJSON *a = cJSON_GetObjectItemCaseSensitive(root, k1);
-    if (cJSON_IsNumber(a)) return a->valueint;
-    const cJSON *b = cJSON_GetObjectItemCaseSensitive(root, k2);
-    if (cJSON_IsNumber(b)) return b->valueint;
-    return defv;
+    char buf[UWL_PROTO_SMALL_BUF_LEN];
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, sizeof(buf));
+    uwl_proto_resp_begin(&w, id, false);
+    if (uwl_proto_resp_end_us(&w, false, esp_timer_get_time() - s_rx_us) > 0) uwl_ble_notify_text(buf);
 }
 
 static void uwl_ble_cmd_state_snapshot_notify(int id)
@@ -167,21 +146,14 @@ static void uwl_ble_cmd_state_snapshot_notify(int id)
     // For v2 clients, prefer READ of STATE characteristic for large payload stability.
     // We still support legacy behavior (notify full snapshot) when id is not provided.
     if (id >= 0) {
-        cJSON *data = cJSON_CreateObject();
-        if (data) {
-            cJSON_AddStringToObject(data, "hint", "read_state_char");
-            uwl_ble_notify_resp_ok(id, data);
-        } else {
-            uwl_ble_notify_resp_ok(id, NULL);
-        }
+        uwl_proto_writer_t w;
+        uwl_ble_resp_begin(&w, id);
+        uwl_proto_str(&w, "hint", "read_state_char");
+        uwl_ble_resp_send(&w);
         return;
     }
 
-    char *state = uwl_build_state_json();
-    if (state) {
-        uwl_ble_notify_text(state);
-        cJSON_free(state);
-    }
+    if (uwl_proto_encode_state(s_host_buf, sizeof(s_host_buf)) > 0) uwl_ble_notify_text(s_host_buf);
 }
 
 static void uwl_ble_cmd_gpio_get_notify(int pin, int id)
@@ -189,47 +161,86 @@ static void uwl_ble_cmd_gpio_get_notify(int pin, int id)
     uint8_t v = 0;
     const esp_err_t err = uwl_io_state_get(pin, &v);
     if (err != ESP_OK) {
-        uwl_ble_notify_err(id, uwl_err_code_from_esp(err), "gpio_get failed");
+        uwl_ble_notify_err(id, uwl_proto_err_code(err), "gpio_get failed");
         return;
     }
 
     // Legacy response type (kept for compatibility)
-    cJSON *o = cJSON_CreateObject();
-    if (!o) {
-        uwl_ble_notify_err(id, "NO_MEM", "no mem");
-        return;
-    }
-    cJSON_AddStringToObject(o, "type", "gpio");
-    cJSON_AddNumberToObject(o, "pin", pin);
-    cJSON_AddNumberToObject(o, "value", v ? 1 : 0);
-    if (id >= 0) cJSON_AddNumberToObject(o, "id", id);
-    char *s = cJSON_PrintUnformatted(o);
-    cJSON_Delete(o);
-    if (s) {
-        uwl_ble_notify_text(s);
-        cJSON_free(s);
-    }
+    char buf[UWL_PROTO_SMALL_BUF_LEN];
+    if (uwl_proto_encode_gpio(buf, sizeof(buf), pin, v, id) > 0) uwl_ble_notify_text(buf);
 }
 
 static void uwl_ble_cmd_gpio_set_ack(int pin, int value, int id)
 {
     const esp_err_t err = uwl_io_state_set(pin, value ? 1 : 0, UWL_IO_SOURCE_BLE);
     if (err != ESP_OK) {
-        uwl_ble_notify_err(id, uwl_err_code_from_esp(err), "gpio_set failed");
+        uwl_ble_notify_err(id, uwl_proto_err_code(err), "gpio_set failed");
         return;
     }
-    cJSON *data = cJSON_CreateObject();
-    if (data) {
-        cJSON_AddNumberToObject(data, "pin", pin);
-        cJSON_AddNumberToObject(data, "value", value ? 1 : 0);
+    uwl_lat_record_since(UWL_IO_SOURCE_BLE, UWL_LAT_GPIO, s_rx_us);
+    uwl_proto_writer_t w;
+    uwl_ble_resp_begin(&w, id);
+    uwl_proto_i64(&w, "pin", pin);
+    uwl_proto_u32(&w, "value", value ? 1 : 0);
+    uwl_ble_resp_send(&w);
+}
+
+static void uwl_ble_cmd_gpio_set_mask_ack(uint32_t mask, uint32_t values, int id)
+{
+    const esp_err_t err = uwl_io_state_set_mask(mask, values, UWL_IO_SOURCE_BLE);
+    if (err != ESP_OK) {
+        uwl_ble_notify_err(id, uwl_proto_err_code(err), "gpio_set_mask failed");
+        return;
     }
-    uwl_ble_notify_resp_ok(id, data);
+    uwl_lat_record_since(UWL_IO_SOURCE_BLE, UWL_LAT_GPIO, s_rx_us);
+    uwl_proto_writer_t w;
+    uwl_ble_resp_begin(&w, id);
+    uwl_proto_u32(&w, "mask", mask);
+    uwl_proto_u32(&w, "values", values & mask);
+    uwl_ble_resp_send(&w);
+}
+
+// set_window: false reads the current setting back without touching it
+static void uwl_ble_cmd_gpio_debounce_ack(int pin, bool set_window, uint32_t window_us, int count, int id)
+{
+    esp_err_t err = ESP_OK;
+    if (pin < 0 || count < 0 || count > 255) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if (set_window) {
+        err = uwl_io_state_set_debounce(pin, window_us, (uint8_t)count);
+    }
+    uint32_t w = 0;
+    uint8_t n = 0;
+    if (err == ESP_OK) err = uwl_io_state_get_debounce(pin, &w, &n);
+    if (err != ESP_OK) {
+        uwl_ble_notify_err(id, uwl_proto_err_code(err), "gpio_debounce failed");
+        return;
+    }
+    uwl_proto_writer_t wr;
+    uwl_ble_resp_begin(&wr, id);
+    uwl_proto_i64(&wr, "pin", pin);
+    uwl_proto_u32(&wr, "w", w);
+    uwl_proto_u32(&wr, "n", n);
+    uwl_ble_resp_send(&wr);
+}
+
+// Push filter for this connection; mask UINT32_MAX (the default) is every pin
+static void uwl_ble_cmd_sub_ack(uint32_t mask, int id)
+{
+    s_sub_mask = mask;
+    uwl_proto_writer_t w;
+    uwl_ble_resp_begin(&w, id);
+    uwl_proto_u32(&w, "m", mask);
+    uwl_ble_resp_send(&w);
 }
 
 static void uwl_ble_handle_text_cmd(const char *text)
 {
     // Text protocol for easy manual use (e.g., nRF Connect):
     // s <pin> <0|1>
+    // m <mask> <values>   (hex with 0x prefix accepted)
+    // db <pin> [<window_us> [<count>]]
+    // sub [<mask>]        (no mask: every pin)
     // g <pin>
     // l
     // state
@@ -248,6 +259,30 @@ static void uwl_ble_handle_text_cmd(const char *text)
         uwl_ble_cmd_gpio_set_ack(p, v ? 1 : 0, -1);
         return;
     }
+    if (strcmp(op, "m") == 0) {
+        long mask = 0, values = 0;
+        if (sscanf(t, "%*s %li %li", &mask, &values) == 2) {
+            uwl_ble_cmd_gpio_set_mask_ack((uint32_t)mask, (uint32_t)values, -1);
+            return;
+        }
+    }
+    if (strcmp(op, "sub") == 0) {
+        long mask = -1;
+        (void)sscanf(t, "%*s %li", &mask);
+        uwl_ble_cmd_sub_ack((uint32_t)mask, -1);
+        return;
+    }
+    if (strcmp(op, "db") == 0 && n >= 2) {
+        int c = 0;
+        long w = 0;
+        const int dn = sscanf(t, "%*s %*d %li %d", &w, &c);
+        if (dn >= 1 && w < 0) {
+            uwl_ble_notify_err(-1, "BAD_ARG", "window");
+            return;
+        }
+        uwl_ble_cmd_gpio_debounce_ack(p, dn >= 1, (uint32_t)w, c, -1);
+        return;
+    }
     if ((strcmp(op, "g") == 0 || strcmp(op, "get") == 0) && n >= 2) {
         uwl_ble_cmd_gpio_get_notify(p, -1);
         return;
@@ -261,17 +296,174 @@ static void uwl_ble_handle_text_cmd(const char *text)
         return;
     }
 
-    uwl_ble_notify_err(-1, "BAD_CMD", "use: s <pin> <0|1> | g <pin> | l | state");
+    uwl_ble_notify_err(-1, "BAD_CMD", "use: s <pin> <0|1> | m <mask> <values> | g <pin> | sub [mask] | l | state");
+}
+
+static size_t uwl_ble_coalesce_batch(const uwl_io_event_t *evts, size_t count, uint32_t sub, uwl_io_event_t *out,
+                                     size_t cap)
+{
+    // Notifications are MTU-bound: keep only the latest level per pin
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (uint32_t m = evts[i].mask & sub; m; m &= m - 1U) {
+            const int pin = __builtin_ctz(m);
+            uwl_io_event_t one = evts[i];
+            one.pin = pin;
+            one.value = (uint8_t)((evts[i].values >> pin) & 1U);
+            one.mask = 1UL << pin;
+            one.values = (uint32_t)one.value << pin;
+
+            size_t k = 0;
+            while (k < n && out[k].pin != pin) k++;
+            if (k < n) {
+                out[k] = one;
+            } else if (n < cap) {
+                out[n++] = one;
+            }
+        }
+    }
+    return n;
+}
+
+// Events were lost: a full state JSON does not fit one notify, send the bitmask form
+static void uwl_ble_notify_resync_mask(void)
+{
+    char buf[UWL_PROTO_SMALL_BUF_LEN];
+    if (uwl_proto_encode_resync_mask(buf, sizeof(buf)) > 0) uwl_ble_notify_text(buf);
+}
+
+// Encoder cap for one notification: ATT_MTU - 3 payload bytes plus the NUL
+static size_t uwl_ble_notify_cap(size_t buf_cap)
+{
+    uint16_t mtu = ble_att_mtu(s_conn_handle);
+    if (mtu < BLE_ATT_MTU_DFLT) mtu = BLE_ATT_MTU_DFLT;
+    const size_t cap = (size_t)mtu - 3 + 1;
+    return cap < buf_cap ? cap : buf_cap;
 }
 
-static void uwl_ble_on_io_event(const uwl_io_event_t *evt, void *ctx)
+static void uwl_ble_notify_events(const uwl_io_event_t *evts, size_t count, char *buf, size_t cap)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (evts[i].reason == UWL_IO_REASON_RESYNC) {
+            uwl_ble_notify_resync_mask();
+            return;
+        }
+    }
+
+    cap = uwl_ble_notify_cap(cap);
+    uwl_io_event_t latest[32];
+    for (size_t i = 0; i < count; i++) {
+        if (evts[i].reason != UWL_IO_REASON_MODE || !((s_sub_mask >> evts[i].pin) & 1U)) continue;
+        if (uwl_proto_encode_mode(buf, cap, &evts[i]) > 0) uwl_ble_notify_text(buf);
+    }
+
+    // A batch that outgrows one notification is split at event boundaries
+    size_t n = uwl_ble_coalesce_batch(evts, count, s_sub_mask, latest, sizeof(latest) / sizeof(latest[0]));
+    const uwl_io_event_t *next = latest;
+    while (n > 0) {
+        size_t used = 0;
+        if (uwl_proto_encode_changed(buf, cap, next, n, UINT32_MAX, &used) > 0) uwl_ble_notify_text(buf);
+        next += used;
+        n -= used;
+    }
+}
+
+static void uwl_ble_on_io_batch(const uwl_io_event_t *evts, size_t count, void *ctx)
 {
     (void)ctx;
-    if (!evt) return;
-    char *msg = uwl_build_gpio_changed_json(evt);
-    if (!msg) return;
-    uwl_ble_notify_text(msg);
-    cJSON_free(msg);
+    if (!evts || count == 0) return;
+    if (!s_state_notify_enabled || s_conn_handle == BLE_HS_CONN_HANDLE_NONE) return;
+    uwl_ble_notify_events(evts, count, s_evt_buf, sizeof(s_evt_buf));
+}
+
+// Reconnect catch-up: replay only what the client missed since its last seq.
+// Past a few pins the deltas outgrow one notify, so the bitmask form wins.
+static void uwl_ble_cmd_sync(uint32_t boot_id, uint32_t since_seq, int id)
+{
+    size_t n = 0;
+    bool full = true;
+    if (uwl_io_state_history_since(boot_id, since_seq, s_sync_evts, CONFIG_UWL_IO_HISTORY_LEN, &n) == ESP_OK) {
+        uint32_t pins = 0;
+        for (size_t i = 0; i < n; i++) pins |= s_sync_evts[i].mask & s_sub_mask;
+        if (__builtin_popcount(pins) <= UWL_BLE_SYNC_MAX_PINS) {
+            uwl_ble_notify_events(s_sync_evts, n, s_host_buf, sizeof(s_host_buf));
+            full = false;
+        }
+    }
+    if (full) uwl_ble_notify_resync_mask();
+
+    uwl_proto_writer_t w;
+    uwl_ble_resp_begin(&w, id);
+    uwl_proto_u32(&w, "n", full ? 0 : (uint32_t)n);
+    uwl_proto_bool(&w, "full", full);
+    uwl_ble_resp_send(&w);
+}
+
+static void uwl_ble_handle_json_cmd(const char *json, size_t len)
+{
+    uwl_proto_cmd_t cmd;
+    if (uwl_proto_parse_cmd(json, len, &cmd) != ESP_OK) {
+        uwl_ble_notify_err(-1, "BAD_JSON", "parse failed");
+        return;
+    }
+
+    const char *type = cmd.type;
+    const int id = uwl_proto_get_int(&cmd, UWL_PROTO_F_ID, -1);
+    const int pin = uwl_proto_get_int(&cmd, UWL_PROTO_F_PIN, -1);
+    const int value = uwl_proto_get_int(&cmd, UWL_PROTO_F_VALUE, 0);
+
+    if (type[0] == '\0') {
+        uwl_ble_notify_err(id, "BAD_CMD", "missing type");
+    }
+    // set
+    else if (strcmp(type, "gpio_set") == 0 || strcmp(type, "s") == 0 || strcmp(type, "set") == 0) {
+        if (pin < 0) {
+            uwl_ble_notify_err(id, "BAD_ARG", "missing pin");
+        } else {
+            uwl_ble_cmd_gpio_set_ack(pin, value ? 1 : 0, id);
+        }
+    }
+    // batch set
+    else if (strcmp(type, "gpio_set_mask") == 0 || strcmp(type, "m") == 0) {
+        const uint32_t mask = uwl_proto_get_u32(&cmd, UWL_PROTO_F_MASK, 0);
+        const uint32_t values = uwl_proto_get_u32(&cmd, UWL_PROTO_F_VALUE, 0);
+        uwl_ble_cmd_gpio_set_mask_ack(mask, values, id);
+    }
+    // input debounce
+    else if (strcmp(type, "gpio_debounce") == 0 || strcmp(type, "db") == 0) {
+        const bool set_window = uwl_proto_has(&cmd, UWL_PROTO_F_WINDOW);
+        const int64_t w = uwl_proto_get(&cmd, UWL_PROTO_F_WINDOW, 0);
+        if (w < 0 || w > UINT32_MAX) {
+            uwl_ble_notify_err(id, "BAD_ARG", "window");
+        } else {
+            uwl_ble_cmd_gpio_debounce_ack(pin, set_window, (uint32_t)w,
+                                          uwl_proto_get_int(&cmd, UWL_PROTO_F_COUNT, 0), id);
+        }
+    }
+    // get
+    else if (strcmp(type, "gpio_get") == 0 || strcmp(type, "g") == 0 || strcmp(type, "get") == 0) {
+        if (pin < 0) {
+            uwl_ble_notify_err(id, "BAD_ARG", "missing pin");
+        } else {
+            uwl_ble_cmd_gpio_get_notify(pin, id);
+            if (id >= 0) uwl_ble_notify_resp_ok(id);
+        }
+    }
+    // catch up after reconnect
+    else if (strcmp(type, "subscribe") == 0 || strcmp(type, "sub") == 0) {
+        uwl_ble_cmd_sub_ack(uwl_proto_get_u32(&cmd, UWL_PROTO_F_MASK, UINT32_MAX), id);
+    }
+    else if (strcmp(type, "sync") == 0) {
+        uwl_ble_cmd_sync(uwl_proto_get_u32(&cmd, UWL_PROTO_F_BOOT, 0),
+                         uwl_proto_get_u32(&cmd, UWL_PROTO_F_SINCE, 0), id);
+    }
+    // list/state
+    else if (strcmp(type, "gpio_list") == 0 || strcmp(type, "l") == 0 || strcmp(type, "state") == 0) {
+        uwl_ble_cmd_state_snapshot_notify(id);
+    }
+    else {
+        uwl_ble_notify_err(id, "BAD_CMD", "unknown type");
+    }
 }
 
 static int uwl_gatt_access_cb(uint16_t conn_handle,
@@ -291,85 +483,49 @@ static int uwl_gatt_access_cb(uint16_t conn_handle,
     //
     // v2 short-form (recommended):
     // - {"t":"s","p":X,"v":0|1,"i":id}
+    // - {"t":"m","m":mask,"v":values,"i":id}
+    // - {"t":"db","p":X,"w":window_us,"n":count,"i":id}  (omit "w" to read)
+    // - {"t":"sync","b":boot,"s":last_seq,"i":id}  (missed events only, else resync)
+    // - {"t":"sub","m":mask,"i":id}  (pushes only for these pins; omit "m" for all)
     // - {"t":"g","p":X,"i":id}
     // - {"t":"l","i":id}
     // - {"t":"state","i":id}  (prefer STATE characteristic read for full payload)
     //
     // Text form (manual tools):
-    // - "s 18 1" / "g 18" / "l" / "state"
+    // - "s 18 1" / "m 0x0c0000 0x040000" / "db 10 5000 4" / "g 18" / "l" / "state"
     if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        s_rx_us = esp_timer_get_time();
         const uint16_t len = OS_MBUF_PKTLEN(ctxt->om);
-        char *buf = (char *)calloc(1, len + 1);
-        if (!buf) return BLE_ATT_ERR_INSUFFICIENT_RES;
-        os_mbuf_copydata(ctxt->om, 0, len, buf);
+        if (len > UWL_BLE_RX_MAX_LEN) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        char *const buf = s_rx_buf;
+        if (os_mbuf_copydata(ctxt->om, 0, len, buf) != 0) return BLE_ATT_ERR_UNLIKELY;
         buf[len] = '\0';
 
         const char *t0 = uwl_skip_ws(buf);
-        if (!t0) {
-            free(buf);
-            return 0;
-        }
-
-        // Text protocol
-        if (*t0 != '{') {
-            uwl_ble_handle_text_cmd(t0);
-            free(buf);
-            return 0;
-        }
-
-        // JSON protocol
-        cJSON *root = cJSON_Parse(t0);
-        free(buf);
-        if (!root) {
-            uwl_ble_notify_err(-1, "BAD_JSON", "parse failed");
-            return 0;
-        }
-
-        const char *type = uwl_json_get_str2(root, "type", "t");
-        const int id = uwl_json_get_i32_2(root, "id", "i", -1);
-        const int pin = uwl_json_get_i32_2(root, "pin", "p", -1);
-        const int value = uwl_json_get_i32_2(root, "value", "v", 0);
-
-        if (type) {
-            // set
-            if (strcmp(type, "gpio_set") == 0 || strcmp(type, "s") == 0 || strcmp(type, "set") == 0) {
-                if (pin < 0) {
-                    uwl_ble_notify_err(id, "BAD_ARG", "missing pin");
-                } else {
-                    uwl_ble_cmd_gpio_set_ack(pin, value ? 1 : 0, id);
-                }
-            }
-            // get
-            else if (strcmp(type, "gpio_get") == 0 || strcmp(type, "g") == 0 || strcmp(type, "get") == 0) {
-                if (pin < 0) {
-                    uwl_ble_notify_err(id, "BAD_ARG", "missing pin");
-                } else {
-                    uwl_ble_cmd_gpio_get_notify(pin, id);
-                    if (id >= 0) uwl_ble_notify_resp_ok(id, NULL);
-                }
-            }
-            // list/state
-            else if (strcmp(type, "gpio_list") == 0 || strcmp(type, "l") == 0 ||
-                     strcmp(type, "state") == 0) {
-                uwl_ble_cmd_state_snapshot_notify(id);
+        if (t0 && !uwl_rate_take(&s_rx_rate, esp_timer_get_time())) {
+            // Over budget: nothing runs; JSON callers still get their id back
+            uwl_proto_cmd_t cmd;
+            int id = -1;
+            if (*t0 == '{' && uwl_proto_parse_cmd(t0, len - (size_t)(t0 - buf), &cmd) == ESP_OK) {
+                id = uwl_proto_get_int(&cmd, UWL_PROTO_F_ID, -1);
             }
-            else {
-                uwl_ble_notify_err(id, "BAD_CMD", "unknown type");
-            }
-        } else {
-            uwl_ble_notify_err(id, "BAD_CMD", "missing type");
+            __atomic_fetch_add(&s_rate_limited, 1U, __ATOMIC_RELAXED);
+            uwl_ble_notify_err(id, "RATE_LIMITED", "too many writes");
+        } else if (t0 && *t0 == '{') {
+            uwl_ble_handle_json_cmd(t0, len - (size_t)(t0 - buf));
+        } else if (t0) {
+            // Text protocol
+            uwl_ble_handle_text_cmd(t0);
         }
-
-        cJSON_Delete(root);
+        uwl_lat_record_since(UWL_IO_SOURCE_BLE, UWL_LAT_ACK, s_rx_us);
         return 0;
     }
 
     // STATE characteristic: read returns full snapshot JSON
     if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
-        char *state = uwl_build_state_json();
-        if (!state) return BLE_ATT_ERR_INSUFFICIENT_RES;
-        const int rc = os_mbuf_append(ctxt->om, state, strlen(state));
-        cJSON_free(state);
+        const int n = uwl_proto_encode_state(s_host_buf, sizeof(s_host_buf));
+        if (n <= 0) return BLE_ATT_ERR_INSUFFICIENT_RES;
+        const int rc = os_mbuf_append(ctxt->om, s_host_buf, (uint16_t)n);
         return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
     }
 
@@ -405,7 +561,11 @@ static int uwl_gap_event(struct ble_gap_event *event, void *arg)
     case BLE_GAP_EVENT_CONNECT:
         if (event->connect.status == 0) {
             s_conn_handle = event->connect.conn_handle;
+            s_sub_mask = UINT32_MAX;
+            uwl_rate_init(&s_rx_rate, CONFIG_UWL_RATE_BLE_CLIENT_PER_S, CONFIG_UWL_RATE_BLE_CLIENT_BURST,
+                          esp_timer_get_time());
             ESP_LOGI(TAG, "BLE connected, conn_handle=%u", (unsigned)s_conn_handle);
+            uwl_status_changed();
         } else {
             ESP_LOGW(TAG, "BLE connect failed (status=%d); restarting adv", event->connect.status);
             s_conn_handle = BLE_HS_CONN_HANDLE_NONE;
@@ -418,6 +578,7 @@ static int uwl_gap_event(struct ble_gap_event *event, void *arg)
         ESP_LOGI(TAG, "BLE disconnected (reason=%d)", event->disconnect.reason);
         s_conn_handle = BLE_HS_CONN_HANDLE_NONE;
         s_state_notify_enabled = false;
+        uwl_status_changed();
         uwl_ble_advertise_start();
         return 0;
 
@@ -425,6 +586,7 @@ static int uwl_gap_event(struct ble_gap_event *event, void *arg)
         if (event->subscribe.attr_handle == s_state_chr_val_handle) {
             s_state_notify_enabled = event->subscribe.cur_notify;
             ESP_LOGI(TAG, "BLE subscribe state notify=%d", (int)s_state_notify_enabled);
+            uwl_status_changed();
         }
         return 0;
 
@@ -514,7 +676,12 @@ esp_err_t uwl_ble_gatt_start(void)
     }
 
     // Notify on IO changes
-    (void)uwl_io_state_add_listener(uwl_ble_on_io_event, NULL);
+    const uwl_io_listener_cfg_t lcfg = {
+        .name = "uwl_ble_tx",
+        .batch_fn = uwl_ble_on_io_batch,
+        .policy = UWL_IO_OVERFLOW_COALESCE,
+    };
+    (void)uwl_io_state_add_listener_ex(&lcfg);
 
     nimble_port_freertos_init(uwl_host_task);
     ESP_LOGI(TAG, "BLE GATT started");
@@ -538,5 +705,15 @@ bool uwl_ble_is_state_notify_enabled(void)
     return false;
 }
 
+uint32_t uwl_ble_get_rate_limited(void)
+{
+    return 0;
+}
+
+void uwl_ble_get_notify_stats(uwl_ble_notify_stats_t *out)
+{
+    if (out) *out = (uwl_ble_notify_stats_t){ 0 };
+}
+
 #endif
 
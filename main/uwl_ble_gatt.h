@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "esp_err.h"
 
@@ -8,9 +9,17 @@
 extern "C" {
 #endif
 
+typedef struct {
+    uint32_t sent;   // STATE notifications queued by the host
+    uint32_t failed; // mbuf or host errors (notification lost)
+} uwl_ble_notify_stats_t;
+
 esp_err_t uwl_ble_gatt_start(void);
 bool uwl_ble_is_connected(void);
 bool uwl_ble_is_state_notify_enabled(void);
+// CTRL writes refused by the per-connection rate limit since boot
+uint32_t uwl_ble_get_rate_limited(void);
+void uwl_ble_get_notify_stats(uwl_ble_notify_stats_t *out);
 
 #ifdef __cplusplus
 }
@@ -1,9 +1,17 @@
 #include "uwl_gpio.h"
 
+#include <inttypes.h>
 #include <stdint.h>
 
 #include "driver/gpio.h"
+#include "driver/gpio_filter.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "hal/gpio_ll.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc_caps.h"
+#include "soc/soc.h"
 
 #include "uwl_io_state.h"
 
@@ -20,13 +28,221 @@ static const char *TAG = "uwl_gpio";
 #endif
 #endif
 
+#ifndef CONFIG_UWL_GPIO_STORM_GUARD
+#define CONFIG_UWL_GPIO_STORM_GUARD 0
+#endif
+#ifndef CONFIG_UWL_GPIO_STORM_MAX_RATE
+#define CONFIG_UWL_GPIO_STORM_MAX_RATE 2000
+#endif
+#ifndef CONFIG_UWL_GPIO_STORM_POLL_HZ
+#define CONFIG_UWL_GPIO_STORM_POLL_HZ 200
+#endif
+#ifndef CONFIG_UWL_GPIO_STORM_HOLD_MS
+#define CONFIG_UWL_GPIO_STORM_HOLD_MS 1000
+#endif
+
+// Storm detection counts edges in fixed slices so the ISR needs no division
+#define UWL_STORM_SLICE_US 10000
+#define UWL_STORM_SLICE_EDGES \
+    ((CONFIG_UWL_GPIO_STORM_MAX_RATE / (1000000 / UWL_STORM_SLICE_US)) ? (CONFIG_UWL_GPIO_STORM_MAX_RATE / (1000000 / UWL_STORM_SLICE_US)) : 1)
+#define UWL_STORM_HOLD_MAX_MS (CONFIG_UWL_GPIO_STORM_HOLD_MS * 32U)
+
 static bool s_isr_service_installed = false;
+static portMUX_TYPE s_out_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Software debounce: the first edge arms a sampling timer; the level is
+// reported once it reads the same for stable_needed consecutive samples
+// spread over window_us. Edges while sampling are only counted.
+typedef struct {
+    uint32_t window_us;      // 0 = debounce off, edges forwarded directly
+    uint8_t stable_needed;
+    uint8_t stable;
+    uint8_t last;
+    volatile bool sampling;
+    int64_t first_edge_us;   // ISR timestamp of the edge that started sampling
+    esp_timer_handle_t timer;
+    uint32_t raw_edges;      // ISR entries
+    uint32_t reported;       // levels handed to io_state
+} uwl_gpio_debounce_t;
+
+static uwl_gpio_debounce_t s_deb[SOC_GPIO_PIN_COUNT];
+static portMUX_TYPE s_deb_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Interrupt storm guard: a pin firing faster than STORM_MAX_RATE has its
+// interrupt masked and is sampled from a timer instead. Interrupts are
+// re-armed after a hold period; the hold doubles each time the storm is
+// still there right after re-arming.
+typedef struct {
+    int64_t slice_start_us;
+    uint32_t slice_edges;
+    volatile bool polling;
+    volatile bool entered;   // set by the ISR, consumed by the first poll tick
+    esp_timer_handle_t timer;
+    int64_t armed_us;        // last time the interrupt was (re-)enabled
+    int64_t poll_since_us;   // start of the current re-arm evaluation window
+    uint32_t hold_ms;
+    uint32_t poll_edges;     // level changes seen by the sampler in this window
+    uint32_t trip_rate;      // edges/s measured in the slice that tripped
+    uint32_t storms;
+    uint8_t poll_level;
+} uwl_gpio_storm_t;
+
+static uwl_gpio_storm_t s_storm[SOC_GPIO_PIN_COUNT];
+
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+// Hardware glitch filter per input pin, released when the pin is reconfigured
+static gpio_glitch_filter_handle_t s_glitch[SOC_GPIO_PIN_COUNT];
+#endif
+
+// ISR context. Returns true if the edge must not be processed further.
+static inline bool IRAM_ATTR uwl_storm_check_isr(int pin, uwl_gpio_storm_t *s, int64_t now)
+{
+    if (!s->timer) return false;
+    // Edge latched just before the interrupt was masked
+    if (s->polling) return true;
+
+    if (now - s->slice_start_us >= UWL_STORM_SLICE_US) {
+        s->slice_start_us = now;
+        s->slice_edges = 0;
+    }
+    if (++s->slice_edges <= UWL_STORM_SLICE_EDGES) return false;
+
+    gpio_ll_intr_disable(&GPIO, (uint32_t)pin);
+    // Tripping again within one base hold of re-arming: back off further
+    if (s->armed_us && now - s->armed_us < (int64_t)CONFIG_UWL_GPIO_STORM_HOLD_MS * 1000) {
+        s->hold_ms = s->hold_ms * 2 > UWL_STORM_HOLD_MAX_MS ? UWL_STORM_HOLD_MAX_MS : s->hold_ms * 2;
+    } else {
+        s->hold_ms = CONFIG_UWL_GPIO_STORM_HOLD_MS;
+    }
+    s->trip_rate = s->slice_edges * (1000000 / UWL_STORM_SLICE_US);
+    s->storms++;
+    s->polling = true;
+    s->entered = true;
+    (void)esp_timer_start_periodic(s->timer, 1000000 / CONFIG_UWL_GPIO_STORM_POLL_HZ);
+    return true;
+}
+
+static inline uint64_t uwl_deb_period_us(const uwl_gpio_debounce_t *d)
+{
+    const uint32_t p = d->window_us / (d->stable_needed ? d->stable_needed : 1);
+    return p < 50 ? 50 : p;
+}
 
 static void IRAM_ATTR uwl_gpio_isr_handler(void *arg)
 {
     const int pin = (int)(intptr_t)arg;
+    const int64_t now = esp_timer_get_time();
+    const uint8_t level = (uint8_t)gpio_get_level(pin);
+    uwl_gpio_debounce_t *d = &s_deb[pin];
+    d->raw_edges++;
+    if (uwl_storm_check_isr(pin, &s_storm[pin], now)) return;
+
+    if (d->window_us == 0 || !d->timer) {
+        d->reported++;
+        uwl_io_state_on_input_edge_isr(pin, level);
+        return;
+    }
+
+    portENTER_CRITICAL_ISR(&s_deb_mux);
+    const bool start = !d->sampling;
+    if (start) {
+        d->sampling = true;
+        d->first_edge_us = now;
+        d->last = level;
+        d->stable = 1;
+    }
+    portEXIT_CRITICAL_ISR(&s_deb_mux);
+
+    if (start) {
+        (void)esp_timer_start_periodic(d->timer, uwl_deb_period_us(d));
+    }
+}
+
+static void uwl_gpio_debounce_sample_cb(void *arg)
+{
+    const int pin = (int)(intptr_t)arg;
+    uwl_gpio_debounce_t *d = &s_deb[pin];
+    const uint8_t level = (uint8_t)gpio_get_level(pin);
+
+    if (level == d->last) {
+        if (d->stable < UINT8_MAX) d->stable++;
+    } else {
+        d->last = level;
+        d->stable = 1;
+    }
+    if (d->stable < d->stable_needed) return;
+
+    (void)esp_timer_stop(d->timer);
+    d->reported++;
+    uwl_io_state_on_input_settled(pin, level, d->first_edge_us);
+
+    // An edge that landed between the last sample and here was swallowed
+    // by the sampling guard: re-arm if the pin already moved again.
+    bool rearm = false;
+    portENTER_CRITICAL(&s_deb_mux);
+    d->sampling = false;
+    const uint8_t now_level = (uint8_t)gpio_get_level(pin);
+    if (now_level != level) {
+        d->sampling = true;
+        d->first_edge_us = esp_timer_get_time();
+        d->last = now_level;
+        d->stable = 1;
+        rearm = true;
+    }
+    portEXIT_CRITICAL(&s_deb_mux);
+    if (rearm) {
+        (void)esp_timer_start_periodic(d->timer, uwl_deb_period_us(d));
+    }
+}
+
+static void uwl_gpio_storm_poll_cb(void *arg)
+{
+    const int pin = (int)(intptr_t)arg;
+    uwl_gpio_storm_t *s = &s_storm[pin];
+    const int64_t now = esp_timer_get_time();
     const uint8_t level = (uint8_t)gpio_get_level(pin);
-    uwl_io_state_on_input_edge_isr(pin, level);
+
+    if (s->entered) {
+        s->entered = false;
+        s->poll_since_us = now;
+        s->poll_edges = 0;
+        s->poll_level = level;
+        // A debounce window still open would only report what we sample anyway
+        uwl_gpio_debounce_t *d = &s_deb[pin];
+        if (d->timer) (void)esp_timer_stop(d->timer);
+        d->sampling = false;
+        ESP_LOGW(TAG, "GPIO%d interrupt storm (~%" PRIu32 " edges/s): polling at %d Hz for %" PRIu32 " ms",
+                 pin, s->trip_rate, CONFIG_UWL_GPIO_STORM_POLL_HZ, s->hold_ms);
+        uwl_io_state_on_input_mode(pin, UWL_IO_PIN_MODE_POLL, s->trip_rate);
+    }
+
+    if (level != s->poll_level) {
+        s->poll_level = level;
+        s->poll_edges++;
+    }
+    s_deb[pin].reported++;
+    uwl_io_state_on_input_settled(pin, level, now);
+
+    const int64_t elapsed_us = now - s->poll_since_us;
+    if (elapsed_us < (int64_t)s->hold_ms * 1000) return;
+
+    // The sampler cannot see edges faster than POLL_HZ/2; such a signal is
+    // caught by the ISR check again right after re-arming.
+    const uint32_t rate = (uint32_t)((uint64_t)s->poll_edges * 1000000ULL / (uint64_t)elapsed_us);
+    if (rate >= CONFIG_UWL_GPIO_STORM_MAX_RATE / 2) {
+        s->poll_since_us = now;
+        s->poll_edges = 0;
+        return;
+    }
+
+    (void)esp_timer_stop(s->timer);
+    s->slice_start_us = now;
+    s->slice_edges = 0;
+    s->armed_us = now;
+    s->polling = false;
+    (void)gpio_intr_enable(pin);
+    ESP_LOGI(TAG, "GPIO%d interrupt re-armed (~%" PRIu32 " edges/s)", pin, rate);
+    uwl_io_state_on_input_mode(pin, UWL_IO_PIN_MODE_IRQ, rate);
 }
 
 esp_err_t uwl_gpio_init(void)
@@ -42,8 +258,21 @@ esp_err_t uwl_gpio_init(void)
     return ESP_OK;
 }
 
+static void uwl_gpio_glitch_release(int pin)
+{
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+    if (!s_glitch[pin]) return;
+    (void)gpio_glitch_filter_disable(s_glitch[pin]);
+    (void)gpio_del_glitch_filter(s_glitch[pin]);
+    s_glitch[pin] = NULL;
+#else
+    (void)pin;
+#endif
+}
+
 esp_err_t uwl_gpio_config_output(int pin, uint8_t initial_value)
 {
+    uwl_gpio_glitch_release(pin);
     gpio_config_t cfg = {
         .pin_bit_mask = (1ULL << pin),
         .mode = GPIO_MODE_OUTPUT,
@@ -73,6 +302,19 @@ esp_err_t uwl_gpio_set_level(int pin, uint8_t value)
     return err;
 }
 
+esp_err_t uwl_gpio_set_mask(uint32_t set_mask, uint32_t clear_mask)
+{
+    if (set_mask & clear_mask) return ESP_ERR_INVALID_ARG;
+    if ((set_mask | clear_mask) >> SOC_GPIO_PIN_COUNT) return ESP_ERR_INVALID_ARG;
+
+    // Back-to-back register writes: set and clear land within a couple of bus cycles.
+    portENTER_CRITICAL(&s_out_mux);
+    if (set_mask) REG_WRITE(GPIO_OUT_W1TS_REG, set_mask);
+    if (clear_mask) REG_WRITE(GPIO_OUT_W1TC_REG, clear_mask);
+    portEXIT_CRITICAL(&s_out_mux);
+    return ESP_OK;
+}
+
 esp_err_t uwl_gpio_get_level(int pin, uint8_t *value_out)
 {
     if (!value_out) return ESP_ERR_INVALID_ARG;
@@ -96,9 +338,44 @@ esp_err_t uwl_gpio_config_input_with_isr(int pin, bool pullup, bool pulldown)
         return err;
     }
 
+#if SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER
+    // Hardware filter drops pulses shorter than two IO_MUX clock cycles
+    // before they ever reach the ISR. Best-effort: the software filter
+    // below still applies if this fails.
+    uwl_gpio_glitch_release(pin);
+    const gpio_pin_glitch_filter_config_t filter_cfg = {
+        .clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT,
+        .gpio_num = pin,
+    };
+    if (gpio_new_pin_glitch_filter(&filter_cfg, &s_glitch[pin]) != ESP_OK) {
+        s_glitch[pin] = NULL;
+        ESP_LOGW(TAG, "glitch filter unavailable pin=%d", pin);
+    } else if (gpio_glitch_filter_enable(s_glitch[pin]) != ESP_OK) {
+        uwl_gpio_glitch_release(pin);
+        ESP_LOGW(TAG, "glitch filter enable failed pin=%d", pin);
+    }
+#endif
+
     err = uwl_gpio_init();
     if (err != ESP_OK) return err;
 
+#if CONFIG_UWL_GPIO_STORM_GUARD
+    uwl_gpio_storm_t *storm = &s_storm[pin];
+    if (!storm->timer) {
+        const esp_timer_create_args_t args = {
+            .callback = uwl_gpio_storm_poll_cb,
+            .arg = (void *)(intptr_t)pin,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "uwl_storm",
+            .skip_unhandled_events = true,
+        };
+        // Without the timer the pin simply runs unguarded
+        if (esp_timer_create(&args, &storm->timer) != ESP_OK) {
+            ESP_LOGW(TAG, "storm guard unavailable pin=%d", pin);
+        }
+    }
+#endif
+
     err = gpio_isr_handler_add(pin, uwl_gpio_isr_handler, (void *)(intptr_t)pin);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "gpio_isr_handler_add pin=%d failed: %s", pin, esp_err_to_name(err));
@@ -108,3 +385,45 @@ esp_err_t uwl_gpio_config_input_with_isr(int pin, bool pullup, bool pulldown)
     return ESP_OK;
 }
 
+esp_err_t uwl_gpio_set_debounce(int pin, uint32_t window_us, uint8_t stable_count)
+{
+    if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT) return ESP_ERR_INVALID_ARG;
+    if (window_us > 0 && stable_count == 0) return ESP_ERR_INVALID_ARG;
+    uwl_gpio_debounce_t *d = &s_deb[pin];
+
+    if (window_us > 0 && !d->timer) {
+        const esp_timer_create_args_t args = {
+            .callback = uwl_gpio_debounce_sample_cb,
+            .arg = (void *)(intptr_t)pin,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "uwl_deb",
+            .skip_unhandled_events = true,
+        };
+        const esp_err_t err = esp_timer_create(&args, &d->timer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "debounce timer pin=%d failed: %s", pin, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    if (d->timer) (void)esp_timer_stop(d->timer);
+    portENTER_CRITICAL(&s_deb_mux);
+    d->sampling = false;
+    d->stable_needed = stable_count;
+    d->window_us = window_us;
+    portEXIT_CRITICAL(&s_deb_mux);
+    return ESP_OK;
+}
+
+esp_err_t uwl_gpio_get_debounce(int pin, uwl_gpio_debounce_info_t *out)
+{
+    if (pin < 0 || pin >= SOC_GPIO_PIN_COUNT || !out) return ESP_ERR_INVALID_ARG;
+    const uwl_gpio_debounce_t *d = &s_deb[pin];
+    out->window_us = d->window_us;
+    out->stable_count = d->stable_needed;
+    out->raw_edges = d->raw_edges;
+    out->reported = d->reported;
+    out->polling = s_storm[pin].polling;
+    out->storms = s_storm[pin].storms;
+    return ESP_OK;
+}
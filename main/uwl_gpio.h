@@ -15,8 +15,24 @@ esp_err_t uwl_gpio_config_output(int pin, uint8_t initial_value);
 esp_err_t uwl_gpio_set_level(int pin, uint8_t value);
 esp_err_t uwl_gpio_get_level(int pin, uint8_t *value_out);
 
+// Drive several outputs on the same edge via the W1TS/W1TC registers (bit N = GPIO N)
+esp_err_t uwl_gpio_set_mask(uint32_t set_mask, uint32_t clear_mask);
+
 esp_err_t uwl_gpio_config_input_with_isr(int pin, bool pullup, bool pulldown);
 
+typedef struct {
+    uint32_t window_us;    // 0 = off
+    uint8_t stable_count;  // identical samples required within window_us
+    uint32_t raw_edges;    // interrupts seen
+    uint32_t reported;     // levels forwarded to io_state
+    bool polling;          // interrupt masked by the storm guard, pin sampled
+    uint32_t storms;       // storm guard trips since boot
+} uwl_gpio_debounce_info_t;
+
+// Software debounce for an ISR input (window_us = 0 disables it)
+esp_err_t uwl_gpio_set_debounce(int pin, uint32_t window_us, uint8_t stable_count);
+esp_err_t uwl_gpio_get_debounce(int pin, uwl_gpio_debounce_info_t *out);
+
 #ifdef __cplusplus
 }
 #endif
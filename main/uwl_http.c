@@ -1,46 +1,76 @@
 #include "uwl_http.h"
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "esp_http_server.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "sdkconfig.h"
 
 #include "uwl_ble_gatt.h"
+#include "uwl_io_state.h"
+#include "uwl_lat.h"
+#include "uwl_metrics.h"
+#include "uwl_proto.h"
+#include "uwl_rate.h"
+#include "uwl_sse.h"
+#include "uwl_web_assets.h"
 #include "uwl_wifi_softap.h"
 #include "uwl_ws.h"
 
 static const char *TAG = "uwl_http";
 
-extern const unsigned char _binary_index_html_start[] asm("_binary_index_html_start");
-extern const unsigned char _binary_index_html_end[] asm("_binary_index_html_end");
+// POST /api/gpio body; a 32-entry "c" list fits easily
+#define UWL_HTTP_GPIO_BODY_MAX 1024
 
-extern const unsigned char _binary_control_html_start[] asm("_binary_control_html_start");
-extern const unsigned char _binary_control_html_end[] asm("_binary_control_html_end");
+// Pages with style.css/app.js inlined, embedded gzip-compressed by
+// main/uwl_web_assets.cmake; ETags in uwl_web_assets.h
+extern const unsigned char _binary_control_html_gz_start[] asm("_binary_control_html_gz_start");
+extern const unsigned char _binary_control_html_gz_end[] asm("_binary_control_html_gz_end");
 
-extern const unsigned char _binary_config_html_start[] asm("_binary_config_html_start");
-extern const unsigned char _binary_config_html_end[] asm("_binary_config_html_end");
+extern const unsigned char _binary_config_html_gz_start[] asm("_binary_config_html_gz_start");
+extern const unsigned char _binary_config_html_gz_end[] asm("_binary_config_html_gz_end");
 
-extern const unsigned char _binary_app_js_start[] asm("_binary_app_js_start");
-extern const unsigned char _binary_app_js_end[] asm("_binary_app_js_end");
-
-extern const unsigned char _binary_style_css_start[] asm("_binary_style_css_start");
-extern const unsigned char _binary_style_css_end[] asm("_binary_style_css_end");
+// If-None-Match may list several tags (or W/-prefixed ones); a substring
+// match on our quoted tag is enough since the tag is plain hex.
+static bool uwl_http_etag_matches(httpd_req_t *req, const char *etag)
+{
+    char inm[80];
+    const size_t len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+    if (len == 0) {
+        return false;
+    }
+    // A truncated header only loses trailing tags; still worth a look
+    const esp_err_t err = httpd_req_get_hdr_value_str(req, "If-None-Match", inm, sizeof(inm));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    return strcmp(inm, "*") == 0 || strstr(inm, etag) != NULL;
+}
 
 static esp_err_t uwl_http_send_asset(httpd_req_t *req,
                                     const unsigned char *start,
                                     const unsigned char *end,
-                                    const char *content_type)
+                                    const char *content_type,
+                                    const char *etag)
 {
+    // Always revalidate, but let an unchanged asset cost a 304 instead of a
+    // download. The tag is a hash of the content, so new firmware with a
+    // changed page still shows up on the next load.
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "ETag", etag);
+    if (uwl_http_etag_matches(req, etag)) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
     if (content_type) {
         httpd_resp_set_type(req, content_type);
     }
-    // Avoid aggressive browser caching (mobile browsers can cache embedded assets very hard).
-    // This ensures UI updates show up immediately after flashing new firmware.
-    httpd_resp_set_hdr(req, "Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
-    httpd_resp_set_hdr(req, "Pragma", "no-cache");
-    httpd_resp_set_hdr(req, "Expires", "0");
+    // Every browser that can run the WebUI accepts gzip; a second, raw copy
+    // would only double the flash footprint.
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
     const size_t len = (size_t)(end - start);
     return httpd_resp_send(req, (const char *)start, len);
 }
@@ -48,27 +78,20 @@ static esp_err_t uwl_http_send_asset(httpd_req_t *req,
 static esp_err_t uwl_http_root_handler(httpd_req_t *req)
 {
     // Keep / as the default entrypoint (control page).
-    return uwl_http_send_asset(req, _binary_control_html_start, _binary_control_html_end, "text/html");
+    return uwl_http_send_asset(req, _binary_control_html_gz_start, _binary_control_html_gz_end, "text/html",
+                               UWL_WEB_ETAG_CONTROL_HTML);
 }
 
 static esp_err_t uwl_http_control_handler(httpd_req_t *req)
 {
-    return uwl_http_send_asset(req, _binary_control_html_start, _binary_control_html_end, "text/html");
+    return uwl_http_send_asset(req, _binary_control_html_gz_start, _binary_control_html_gz_end, "text/html",
+                               UWL_WEB_ETAG_CONTROL_HTML);
 }
 
 static esp_err_t uwl_http_config_handler(httpd_req_t *req)
 {
-    return uwl_http_send_asset(req, _binary_config_html_start, _binary_config_html_end, "text/html");
-}
-
-static esp_err_t uwl_http_app_js_handler(httpd_req_t *req)
-{
-    return uwl_http_send_asset(req, _binary_app_js_start, _binary_app_js_end, "application/javascript");
-}
-
-static esp_err_t uwl_http_style_css_handler(httpd_req_t *req)
-{
-    return uwl_http_send_asset(req, _binary_style_css_start, _binary_style_css_end, "text/css");
+    return uwl_http_send_asset(req, _binary_config_html_gz_start, _binary_config_html_gz_end, "text/html",
+                               UWL_WEB_ETAG_CONFIG_HTML);
 }
 
 static esp_err_t uwl_http_favicon_handler(httpd_req_t *req)
@@ -85,37 +108,218 @@ static esp_err_t uwl_http_api_status_handler(httpd_req_t *req)
     const bool ble_conn = uwl_ble_is_connected();
     const bool ble_notify = uwl_ble_is_state_notify_enabled();
 
-    char buf[192];
+    uwl_io_drop_stats_t drops;
+    uwl_io_state_get_drop_stats(&drops);
+    uwl_io_rate_stats_t rate;
+    uwl_io_state_get_rate_stats(&rate);
+    uwl_ws_keepalive_stats_t ka;
+    uwl_ws_get_keepalive_stats(&ka);
+
+    char buf[640];
     const int n = snprintf(buf, sizeof(buf),
-                           "{\"sta_count\":%d,\"ws_clients\":%u,\"ble_connected\":%s,\"ble_notify\":%s}",
+                           "{\"sta_count\":%d,\"ws_clients\":%u,\"ws_reaped\":%" PRIu32 ",\"sse_clients\":%u,\"ble_connected\":%s,\"ble_notify\":%s,"
+                           "\"evt_drops\":{\"unknown\":%" PRIu32 ",\"wifi\":%" PRIu32 ",\"usb\":%" PRIu32
+                           ",\"ble\":%" PRIu32 ",\"local\":%" PRIu32 ",\"http\":%" PRIu32 "},"
+                           "\"evt_resyncs\":%" PRIu32 ",\"evt_resync_pending\":%s,"
+                           "\"rate_limited\":{\"wifi\":%" PRIu32 ",\"usb\":%" PRIu32 ",\"ble\":%" PRIu32 ",\"http\":%" PRIu32
+                           ",\"ws_frames\":%" PRIu32 ",\"ble_writes\":%" PRIu32 "}}",
                            sta,
                            (unsigned)ws,
+                           ka.reaped,
+                           (unsigned)uwl_sse_get_client_count(),
                            ble_conn ? "true" : "false",
-                           ble_notify ? "true" : "false");
+                           ble_notify ? "true" : "false",
+                           drops.dropped[UWL_IO_SOURCE_UNKNOWN],
+                           drops.dropped[UWL_IO_SOURCE_WIFI],
+                           drops.dropped[UWL_IO_SOURCE_USB],
+                           drops.dropped[UWL_IO_SOURCE_BLE],
+                           drops.dropped[UWL_IO_SOURCE_LOCAL],
+                           drops.dropped[UWL_IO_SOURCE_HTTP],
+                           drops.resyncs,
+                           drops.resync_pending ? "true" : "false",
+                           rate.limited[UWL_IO_SOURCE_WIFI],
+                           rate.limited[UWL_IO_SOURCE_USB],
+                           rate.limited[UWL_IO_SOURCE_BLE],
+                           rate.limited[UWL_IO_SOURCE_HTTP],
+                           uwl_ws_get_rate_limited(),
+                           uwl_ble_get_rate_limited());
     httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, buf, (n < 0) ? HTTPD_RESP_USE_STRLEN : n);
+    if (n < 0 || (size_t)n >= sizeof(buf)) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "status too long");
+    }
+    return httpd_resp_send(req, buf, n);
+}
+
+// {"wifi":{"gpio":{"n":..,"p50_us":..,"p99_us":..,"max_us":..},"ack":{...}},"ble":...,"usb":...,"http":...}
+static esp_err_t uwl_http_api_latency_handler(httpd_req_t *req)
+{
+    static const uwl_io_source_t chans[] = { UWL_IO_SOURCE_WIFI, UWL_IO_SOURCE_BLE, UWL_IO_SOURCE_USB,
+                                              UWL_IO_SOURCE_HTTP };
+
+    char buf[640];
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, sizeof(buf));
+    uwl_proto_obj_begin(&w, NULL);
+    for (size_t i = 0; i < sizeof(chans) / sizeof(chans[0]); i++) {
+        uwl_proto_obj_begin(&w, uwl_io_source_name(chans[i]));
+        for (int k = 0; k < UWL_LAT_KIND_COUNT; k++) {
+            uwl_lat_summary_t sum;
+            uwl_lat_get(chans[i], (uwl_lat_kind_t)k, &sum);
+            uwl_proto_obj_begin(&w, uwl_lat_kind_name((uwl_lat_kind_t)k));
+            uwl_proto_u32(&w, "n", sum.count);
+            uwl_proto_u32(&w, "p50_us", sum.p50_us);
+            uwl_proto_u32(&w, "p99_us", sum.p99_us);
+            uwl_proto_u32(&w, "max_us", sum.max_us);
+            uwl_proto_obj_end(&w);
+        }
+        uwl_proto_obj_end(&w);
+    }
+    uwl_proto_obj_end(&w);
+    const int n = uwl_proto_finish(&w);
+
+    httpd_resp_set_type(req, "application/json");
+    if (n < 0) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "latency too long");
+    }
+    return httpd_resp_send(req, buf, n);
+}
+
+// Handlers run on the httpd task one at a time, so these are never shared
+static char s_gpio_body[UWL_HTTP_GPIO_BODY_MAX + 1];
+static char s_gpio_state[UWL_PROTO_STATE_BUF_LEN];
+
+// GET /api/gpio: the WS "state" snapshot; ?format=mask: the compact
+// {"type":"resync","boot","seq","mask","out","values"} form
+static esp_err_t uwl_http_api_gpio_get_handler(httpd_req_t *req)
+{
+    bool compact = false;
+    char query[32];
+    char val[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "format", val, sizeof(val)) == ESP_OK) {
+        compact = strcmp(val, "mask") == 0;
+    }
+
+    const int n = compact ? uwl_proto_encode_resync_mask(s_gpio_state, sizeof(s_gpio_state))
+                          : uwl_proto_encode_state(s_gpio_state, sizeof(s_gpio_state));
+    httpd_resp_set_type(req, "application/json");
+    if (n <= 0) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "state too long");
+    }
+    return httpd_resp_send(req, s_gpio_state, n);
+}
+
+// {"mask":M,"values":V} or {"pin":P,"value":V}, merged into *mask/*values
+// (a later write to the same pin wins)
+static esp_err_t uwl_http_gpio_merge(const uwl_proto_cmd_t *c, uint32_t *mask, uint32_t *values)
+{
+    uint32_t m = 0;
+    uint32_t v = 0;
+    if (uwl_proto_has(c, UWL_PROTO_F_MASK)) {
+        m = uwl_proto_get_u32(c, UWL_PROTO_F_MASK, 0);
+        v = uwl_proto_get_u32(c, UWL_PROTO_F_VALUE, 0);
+    } else if (uwl_proto_has(c, UWL_PROTO_F_PIN) && uwl_proto_has(c, UWL_PROTO_F_VALUE)) {
+        const int pin = uwl_proto_get_int(c, UWL_PROTO_F_PIN, -1);
+        if (pin < 0 || pin > 31) return ESP_ERR_INVALID_ARG;
+        m = 1UL << pin;
+        v = uwl_proto_get_int(c, UWL_PROTO_F_VALUE, 0) ? m : 0;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *values = (*values & ~m) | (v & m);
+    *mask |= m;
+    return ESP_OK;
+}
+
+static esp_err_t uwl_http_gpio_parse(const char *body, size_t len, uint32_t *mask, uint32_t *values)
+{
+    uwl_proto_cmd_t cmd;
+    esp_err_t err = uwl_proto_parse_cmd(body, len, &cmd);
+    if (err != ESP_OK) return err;
+    if (!cmd.list) return uwl_http_gpio_merge(&cmd, mask, values);
+
+    size_t off = 0;
+    const char *elem = NULL;
+    size_t elem_len = 0;
+    while ((err = uwl_proto_list_next(&cmd, &off, &elem, &elem_len)) == ESP_OK) {
+        uwl_proto_cmd_t c;
+        if (uwl_proto_parse_cmd(elem, elem_len, &c) != ESP_OK) return ESP_ERR_INVALID_ARG;
+        err = uwl_http_gpio_merge(&c, mask, values);
+        if (err != ESP_OK) return err;
+    }
+    return err == ESP_ERR_NOT_FOUND ? ESP_OK : err;
+}
+
+static esp_err_t uwl_http_gpio_fail(httpd_req_t *req, esp_err_t err, const char *msg)
+{
+    const char *status = "500 Internal Server Error";
+    if (err == ESP_ERR_INVALID_ARG) status = "400 Bad Request";
+    if (err == ESP_ERR_NOT_FOUND) status = "404 Not Found";
+    if (err == ESP_ERR_INVALID_STATE) status = "409 Conflict";
+    if (err == UWL_ERR_RATE_LIMITED) {
+        status = "429 Too Many Requests";
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+    }
+
+    char buf[UWL_PROTO_SMALL_BUF_LEN];
+    const int n = uwl_proto_encode_err(buf, sizeof(buf), -1, uwl_proto_err_code(err), msg);
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, buf, n > 0 ? n : 0);
+}
+
+// POST /api/gpio: every write in the body lands in one uwl_io_state_set_mask,
+// i.e. on the same edge and as one event; any bad entry rejects the lot.
+//   {"mask":M,"values":V} | {"pin":P,"value":V} | {"c":[<either>, ...]}
+static esp_err_t uwl_http_api_gpio_post_handler(httpd_req_t *req)
+{
+    const int64_t rx_us = esp_timer_get_time();
+    if (req->content_len > UWL_HTTP_GPIO_BODY_MAX) {
+        return httpd_resp_send_err(req, HTTPD_413_CONTENT_TOO_LARGE, "body too large");
+    }
+    size_t got = 0;
+    while (got < req->content_len) {
+        const int r = httpd_req_recv(req, s_gpio_body + got, req->content_len - got);
+        if (r == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (r <= 0) return ESP_FAIL;
+        got += (size_t)r;
+    }
+    s_gpio_body[got] = '\0';
+
+    uint32_t mask = 0;
+    uint32_t values = 0;
+    esp_err_t err = uwl_http_gpio_parse(s_gpio_body, got, &mask, &values);
+    if (err != ESP_OK || mask == 0) return uwl_http_gpio_fail(req, ESP_ERR_INVALID_ARG, "bad gpio write");
+    err = uwl_io_state_set_mask(mask, values, UWL_IO_SOURCE_HTTP);
+    if (err != ESP_OK) return uwl_http_gpio_fail(req, err, "set failed");
+    uwl_lat_record_since(UWL_IO_SOURCE_HTTP, UWL_LAT_GPIO, rx_us);
+
+    char buf[UWL_PROTO_SMALL_BUF_LEN];
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, sizeof(buf));
+    uwl_proto_resp_begin(&w, -1, true);
+    uwl_proto_u32(&w, "mask", mask);
+    uwl_proto_u32(&w, "values", values & mask);
+    const int n = uwl_proto_resp_end_us(&w, true, esp_timer_get_time() - rx_us);
+    httpd_resp_set_type(req, "application/json");
+    err = httpd_resp_send(req, buf, n > 0 ? n : 0);
+    uwl_lat_record_since(UWL_IO_SOURCE_HTTP, UWL_LAT_ACK, rx_us);
+    return err;
 }
 
 esp_err_t uwl_http_start(void)
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     // With multiple clients, browsers open several parallel connections
-    // (html/css/js + /api/status polling + WebSocket). If we hit the default
+    // (page + /api/status polling + WebSocket). If we hit the default
     // socket cap, LRU purge may drop the WS connection causing UI flicker.
     //
     // Increase sockets within LWIP limit and keep LRU purge as a safety net.
-    // NOTE:
-    // esp_http_server internally consumes a few sockets (typically 3),
-    // so max_open_sockets must be <= (CONFIG_LWIP_MAX_SOCKETS - internal).
-    // With CONFIG_LWIP_MAX_SOCKETS=10, the max allowed is 7.
-    #if defined(CONFIG_LWIP_MAX_SOCKETS)
-    config.max_open_sockets = CONFIG_LWIP_MAX_SOCKETS - 3;
-    if (config.max_open_sockets < 4) config.max_open_sockets = 4;
-    #else
-    config.max_open_sockets = 7;
-    #endif
+    config.max_open_sockets = UWL_HTTP_MAX_OPEN_SOCKETS;
     config.lru_purge_enable = true;
     config.uri_match_fn = httpd_uri_match_wildcard;
+    // Pages, /api/* and /ws; more room than the default 8
+    config.max_uri_handlers = 16;
 
     httpd_handle_t server = NULL;
     esp_err_t err = httpd_start(&server, &config);
@@ -148,22 +352,6 @@ esp_err_t uwl_http_start(void)
     };
     httpd_register_uri_handler(server, &config_page);
 
-    httpd_uri_t appjs = {
-        .uri = "/app.js",
-        .method = HTTP_GET,
-        .handler = uwl_http_app_js_handler,
-        .user_ctx = NULL,
-    };
-    httpd_register_uri_handler(server, &appjs);
-
-    httpd_uri_t css = {
-        .uri = "/style.css",
-        .method = HTTP_GET,
-        .handler = uwl_http_style_css_handler,
-        .user_ctx = NULL,
-    };
-    httpd_register_uri_handler(server, &css);
-
     // Avoid noisy 404 in browsers
     httpd_uri_t favicon = {
         .uri = "/favicon.ico",
@@ -181,7 +369,33 @@ esp_err_t uwl_http_start(void)
     };
     httpd_register_uri_handler(server, &api_status);
 
+    httpd_uri_t api_latency = {
+        .uri = "/api/latency",
+        .method = HTTP_GET,
+        .handler = uwl_http_api_latency_handler,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &api_latency);
+
+    httpd_uri_t api_gpio_get = {
+        .uri = "/api/gpio",
+        .method = HTTP_GET,
+        .handler = uwl_http_api_gpio_get_handler,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &api_gpio_get);
+
+    httpd_uri_t api_gpio_post = {
+        .uri = "/api/gpio",
+        .method = HTTP_POST,
+        .handler = uwl_http_api_gpio_post_handler,
+        .user_ctx = NULL,
+    };
+    httpd_register_uri_handler(server, &api_gpio_post);
+
     ESP_ERROR_CHECK(uwl_ws_register(server));
+    ESP_ERROR_CHECK(uwl_sse_register(server));
+    ESP_ERROR_CHECK(uwl_metrics_register(server));
 
     ESP_LOGI(TAG, "HTTP server started");
     return ESP_OK;
@@ -1,11 +1,24 @@
 #pragma once
 
 #include "esp_err.h"
+#include "sdkconfig.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// esp_http_server internally consumes a few sockets (typically 3), so
+// max_open_sockets must be <= (CONFIG_LWIP_MAX_SOCKETS - internal).
+// With CONFIG_LWIP_MAX_SOCKETS=10, the max allowed is 7.
+// Also bounds the WebSocket session table.
+#if defined(CONFIG_LWIP_MAX_SOCKETS) && CONFIG_LWIP_MAX_SOCKETS - 3 >= 4
+#define UWL_HTTP_MAX_OPEN_SOCKETS (CONFIG_LWIP_MAX_SOCKETS - 3)
+#elif defined(CONFIG_LWIP_MAX_SOCKETS)
+#define UWL_HTTP_MAX_OPEN_SOCKETS 4
+#else
+#define UWL_HTTP_MAX_OPEN_SOCKETS 7
+#endif
+
 esp_err_t uwl_http_start(void);
 
 #ifdef __cplusplus
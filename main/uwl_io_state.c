@@ -1,8 +1,12 @@
 #include "uwl_io_state.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
@@ -10,135 +14,439 @@
 #include "sdkconfig.h"
 
 #include "uwl_gpio.h"
+#include "uwl_pin_table.h"
+#include "uwl_rate.h"
 
 static const char *TAG = "uwl_io_state";
 
-#ifndef CONFIG_UWL_GPIO_OUT1
-#define CONFIG_UWL_GPIO_OUT1 18
+#ifndef CONFIG_UWL_GPIO_IN_DEBOUNCE_US
+#define CONFIG_UWL_GPIO_IN_DEBOUNCE_US 0
 #endif
-#ifndef CONFIG_UWL_GPIO_OUT2
-#define CONFIG_UWL_GPIO_OUT2 19
+#ifndef CONFIG_UWL_GPIO_IN_DEBOUNCE_SAMPLES
+#define CONFIG_UWL_GPIO_IN_DEBOUNCE_SAMPLES 4
 #endif
-#ifndef CONFIG_UWL_GPIO_OUT3
-#define CONFIG_UWL_GPIO_OUT3 20
+#ifndef CONFIG_UWL_IO_HISTORY_LEN
+#define CONFIG_UWL_IO_HISTORY_LEN 64
 #endif
-#ifndef CONFIG_UWL_GPIO_OUT4
-#define CONFIG_UWL_GPIO_OUT4 21
+#ifndef CONFIG_UWL_IO_DISPATCH_BATCH_MAX
+#define CONFIG_UWL_IO_DISPATCH_BATCH_MAX 16
 #endif
-#ifndef CONFIG_UWL_GPIO_IN1
-#define CONFIG_UWL_GPIO_IN1 10
+#ifndef CONFIG_UWL_IO_LISTENER_QUEUE_LEN
+#define CONFIG_UWL_IO_LISTENER_QUEUE_LEN 32
+#endif
+#ifndef CONFIG_UWL_RATE_WIFI_PER_S
+#define CONFIG_UWL_RATE_WIFI_PER_S 200
+#endif
+#ifndef CONFIG_UWL_RATE_BLE_PER_S
+#define CONFIG_UWL_RATE_BLE_PER_S 100
+#endif
+#ifndef CONFIG_UWL_RATE_USB_PER_S
+#define CONFIG_UWL_RATE_USB_PER_S 0
+#endif
+#ifndef CONFIG_UWL_RATE_HTTP_PER_S
+#define CONFIG_UWL_RATE_HTTP_PER_S 100
+#endif
+#ifndef CONFIG_UWL_RATE_SOURCE_BURST
+#define CONFIG_UWL_RATE_SOURCE_BURST 64
 #endif
 
-// Conservative: avoid USB D-/D+ default pins on ESP32-C6
-static bool uwl_is_forbidden_pin(int pin)
-{
-    if ((pin == 12) || (pin == 13)) return true; // USB D-/D+
-
-    // Avoid clobbering the onboard status LED (WS2812 data pin) if enabled.
-    #if defined(CONFIG_UWL_ENABLE_STATUS_LED) && CONFIG_UWL_ENABLE_STATUS_LED
-    if (pin == CONFIG_UWL_STATUS_LED_GPIO) return true;
-    #endif
-
-    return false;
-}
+// Pins are 0..30 on ESP32-C6, so one 32-bit word holds one bit per pin.
+#define UWL_IO_PIN_SLOTS 32
 
-static bool uwl_is_valid_pin(int pin)
-{
-    return pin >= 0 && pin <= 30 && !uwl_is_forbidden_pin(pin);
-}
+// Whitelist generated from Kconfig by uwl_pin_table.cmake (const, in flash).
+// Duplicate or reserved Kconfig pins already failed the build there.
+static const uwl_io_entry_t s_entries[UWL_PIN_TABLE_COUNT] = { UWL_PIN_TABLE_ENTRIES };
+static const size_t s_entry_count = UWL_PIN_TABLE_COUNT;
 
-// Expose more pins so the Web UI can control header GPIOs without recompiling.
-static uwl_io_entry_t s_entries[32];
-static size_t s_entry_count = 0;
+_Static_assert(UWL_PIN_TABLE_COUNT > 0, "no GPIO entries configured");
+_Static_assert((UWL_PIN_OUT_MASK & ~UWL_PIN_VALID_MASK) == 0, "output pin outside whitelist");
+_Static_assert((UWL_PIN_VALID_MASK & ((1UL << 12) | (1UL << 13))) == 0, "USB D-/D+ whitelisted");
+#if defined(CONFIG_UWL_ENABLE_STATUS_LED) && CONFIG_UWL_ENABLE_STATUS_LED
+_Static_assert((UWL_PIN_VALID_MASK & (1UL << CONFIG_UWL_STATUS_LED_GPIO)) == 0, "status LED pin whitelisted");
+#endif
 
+// Packed state: bit N describes GPIO N. valid/out are fixed at build time.
+static const uint32_t s_valid_mask = UWL_PIN_VALID_MASK;
+static const uint32_t s_out_mask = UWL_PIN_OUT_MASK;
+static volatile uint32_t s_level_mask = 0;
+static volatile uint32_t s_poll_mask = 0;
+static volatile uint32_t s_applied_seq = 0;
+// seq of the event that last wrote each pin's level; guarded by s_state_mux
+static uint32_t s_pin_seq[UWL_IO_PIN_SLOTS];
+
+// Event sequence counter; bumped from tasks and the GPIO ISR
+static uint32_t s_seq = 0;
+
+// Seqlock generation: odd while a writer is updating the packed state.
+// Writers serialize on s_state_mux (ISR-safe); readers never block.
+static volatile uint32_t s_gen = 0;
+static portMUX_TYPE s_state_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Each listener owns a bounded ring and a worker task, so a slow consumer
+// (e.g. a WS client on a weak link) only lags itself.
 typedef struct {
+    char name[16];
     uwl_io_listener_fn fn;
+    uwl_io_batch_listener_fn batch_fn;
     void *ctx;
+    uwl_io_overflow_policy_t policy;
+
+    portMUX_TYPE mux;      // guards ring + stats below
+    uwl_io_event_t *ring;
+    size_t cap;
+    size_t head;           // oldest pending event
+    size_t count;
+    TaskHandle_t worker;
+
+    uint32_t delivered;
+    uint32_t batches;
+    uint32_t dropped;
+    uint32_t coalesced;
+    uint32_t max_pending;
+    uint32_t max_lag_us;
+    bool resync;           // dropped something: owe this listener a snapshot
 } uwl_listener_t;
 
-static uwl_listener_t s_listeners[8];
-static size_t s_listener_count = 0;
+#define UWL_IO_MAX_LISTENERS 8
+
+static uwl_listener_t s_listeners[UWL_IO_MAX_LISTENERS];
+static volatile size_t s_listener_count = 0;
 
 static SemaphoreHandle_t s_lock = NULL;
 static QueueHandle_t s_evt_q = NULL;
 
-static void uwl_emit_event_from_task(const uwl_io_event_t *evt)
+// Core event queue between producers (ISR, set calls) and the dispatcher
+#define UWL_IO_EVT_QUEUE_LEN 32
+
+// Written only by the dispatcher task
+static uwl_io_dispatch_stats_t s_dispatch_stats = { .queue_len = UWL_IO_EVT_QUEUE_LEN };
+
+// Core queue overflow accounting (updated from tasks and the GPIO ISR)
+static uint32_t s_drop_by_source[UWL_IO_SOURCE_COUNT];
+static uint32_t s_resync_count = 0;
+static volatile bool s_resync_pending = false;
+
+// Per-source write budget, so one noisy channel cannot flood the event
+// queue. LOCAL/UNKNOWN are never limited.
+static uwl_rate_bucket_t s_src_rate[UWL_IO_SOURCE_COUNT];
+static uint32_t s_rate_limited_by_source[UWL_IO_SOURCE_COUNT];
+static portMUX_TYPE s_rate_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Recently dispatched events, for clients catching up after a reconnect.
+// Appended by the dispatcher only; readers copy out under s_hist_lock.
+static uwl_io_event_t s_hist[CONFIG_UWL_IO_HISTORY_LEN];
+static size_t s_hist_head = 0;  // oldest entry
+static size_t s_hist_count = 0;
+static uint32_t s_hist_evicted_seq = 0; // highest seq pushed out of the ring
+static SemaphoreHandle_t s_hist_lock = NULL;
+static uint32_t s_boot_id = 0;
+
+static inline bool uwl_pin_in_mask(int pin, uint32_t mask)
 {
-    if (!evt) return;
+    return pin >= 0 && pin < UWL_IO_PIN_SLOTS && (mask & (1UL << pin)) != 0;
+}
 
-    // Copy listeners under lock; call callbacks without holding it
-    uwl_listener_t listeners_local[8];
-    size_t n = 0;
+// Wrap-safe "a is newer than b"
+static inline bool uwl_seq_after(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) > 0;
+}
+
+static inline uint32_t uwl_next_seq(void)
+{
+    return __atomic_add_fetch(&s_seq, 1, __ATOMIC_RELAXED);
+}
 
-    if (s_lock) xSemaphoreTake(s_lock, portMAX_DELAY);
-    n = s_listener_count;
-    if (n > 8) n = 8;
-    memcpy(listeners_local, s_listeners, n * sizeof(uwl_listener_t));
-    if (s_lock) xSemaphoreGive(s_lock);
+// ISR and task posts interleave, so events reach the dispatcher a little out
+// of seq order; a pin whose seq is this far ahead of an event is never rolled
+// back by it. Bounded so a pin left alone for 2^31 events is not stuck.
+#define UWL_IO_SEQ_REORDER_MAX 0x10000U
 
-    for (size_t i = 0; i < n; i++) {
-        if (listeners_local[i].fn) {
-            listeners_local[i].fn(evt, listeners_local[i].ctx);
+// Caller must hold s_state_mux. seq == 0: level-only update (init). Otherwise
+// pins already written by this seq or a newer one keep their level, so the
+// dispatcher skips what the set call applied and a stale event loses.
+// publish: also move the applied seq forward (never back).
+static inline void uwl_state_write_levels(uint32_t mask, uint32_t values, uint32_t seq, bool publish)
+{
+    if (seq) {
+        for (uint32_t m = mask; m; m &= m - 1U) {
+            const int pin = __builtin_ctz(m);
+            if ((uint32_t)(s_pin_seq[pin] - seq) < UWL_IO_SEQ_REORDER_MAX) {
+                mask &= ~(1UL << pin);
+            } else {
+                s_pin_seq[pin] = seq;
+            }
         }
     }
+    publish = publish && seq && uwl_seq_after(seq, s_applied_seq);
+    if (!mask && !publish) return;
+
+    __atomic_store_n(&s_gen, s_gen + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    s_level_mask = (s_level_mask & ~mask) | (values & mask);
+    if (publish) s_applied_seq = seq;
+
+    __atomic_store_n(&s_gen, s_gen + 1, __ATOMIC_RELEASE);
+}
+
+static void uwl_note_drop(uwl_io_source_t source)
+{
+    if ((unsigned)source >= UWL_IO_SOURCE_COUNT) source = UWL_IO_SOURCE_UNKNOWN;
+    __atomic_add_fetch(&s_drop_by_source[source], 1, __ATOMIC_RELAXED);
+    s_resync_pending = true;
+}
+
+static void uwl_evt_post(const uwl_io_event_t *evt)
+{
+    if (xQueueSend(s_evt_q, evt, 0) != pdTRUE) {
+        uwl_note_drop(evt->source);
+    }
 }
 
-static int uwl_find_entry_idx(int pin)
+// Dispatcher/init path. The applied seq is published here and not by the set
+// call, so a snapshot never claims a seq while an older queued event is still
+// missing from it.
+static void uwl_state_apply_levels(uint32_t mask, uint32_t values, uint32_t seq)
 {
-    for (size_t i = 0; i < s_entry_count; i++) {
-        if (s_entries[i].pin == pin) return (int)i;
+    mask &= s_valid_mask;
+    if (!mask && !seq) return;
+    portENTER_CRITICAL_SAFE(&s_state_mux);
+    uwl_state_write_levels(mask, values, seq, true);
+    portEXIT_CRITICAL_SAFE(&s_state_mux);
+}
+
+static void uwl_state_apply_level(int pin, uint8_t v)
+{
+    if (!uwl_pin_in_mask(pin, s_valid_mask)) return;
+    uwl_state_apply_levels(1UL << pin, v ? (1UL << pin) : 0, 0);
+}
+
+// Caller must hold l->mux. Removes the pending event at ring offset idx,
+// closing the gap from whichever end is nearer (dropping the oldest is O(1)).
+static void uwl_listener_ring_remove(uwl_listener_t *l, size_t idx)
+{
+    if (idx < l->count / 2) {
+        for (size_t i = idx; i > 0; i--) {
+            l->ring[(l->head + i) % l->cap] = l->ring[(l->head + i - 1) % l->cap];
+        }
+        l->head = (l->head + 1) % l->cap;
+    } else {
+        for (size_t i = idx; i + 1 < l->count; i++) {
+            l->ring[(l->head + i) % l->cap] = l->ring[(l->head + i + 1) % l->cap];
+        }
     }
-    return -1;
+    l->count--;
 }
 
-static void uwl_io_dispatcher_task(void *arg)
+// Caller must hold l->mux.
+static void uwl_listener_ring_push(uwl_listener_t *l, const uwl_io_event_t *evt)
 {
-    (void)arg;
-    uwl_io_event_t evt;
-    while (true) {
-        if (xQueueReceive(s_evt_q, &evt, portMAX_DELAY) == pdTRUE) {
-            // Keep cached snapshot consistent in one place (task context)
-            if (s_lock) xSemaphoreTake(s_lock, portMAX_DELAY);
-            const int idx = uwl_find_entry_idx(evt.pin);
-            if (idx >= 0) {
-                s_entries[idx].value = evt.value ? 1 : 0;
+    if (l->count == l->cap) {
+        size_t victim = 0; // oldest
+        bool merged = false;
+        if (l->policy == UWL_IO_OVERFLOW_COALESCE) {
+            // Latest level per pin wins: retire an older event for the same pins
+            for (size_t i = 0; i < l->count; i++) {
+                const uwl_io_event_t *old = &l->ring[(l->head + i) % l->cap];
+                // pin matters for mode events, which carry no mask
+                if (old->mask == evt->mask && old->pin == evt->pin) {
+                    victim = i;
+                    merged = true;
+                    break;
+                }
             }
-            if (s_lock) xSemaphoreGive(s_lock);
-            uwl_emit_event_from_task(&evt);
         }
+        if (merged) {
+            l->coalesced++;
+        } else {
+            l->dropped++;
+            l->resync = true;
+        }
+        uwl_listener_ring_remove(l, victim);
     }
+
+    l->ring[(l->head + l->count) % l->cap] = *evt;
+    l->count++;
+    if (l->count > l->max_pending) l->max_pending = (uint32_t)l->count;
 }
 
-static void uwl_add_entry(int pin, uwl_io_dir_t dir)
+static void uwl_make_resync_event(uwl_io_event_t *out, uint32_t seq)
 {
-    if (!uwl_is_valid_pin(pin)) return;
-    if (s_entry_count >= (sizeof(s_entries) / sizeof(s_entries[0]))) return;
-    if (uwl_find_entry_idx(pin) >= 0) return;
-
-    s_entries[s_entry_count++] = (uwl_io_entry_t){
+    uwl_io_snapshot_t snap;
+    uwl_io_state_snapshot(&snap);
+    const int pin = snap.valid_mask ? __builtin_ctz(snap.valid_mask) : 0;
+    *out = (uwl_io_event_t){
         .pin = pin,
-        .dir = dir,
-        .value = 0,
+        .value = (uint8_t)((snap.level_mask >> pin) & 1U),
+        .dir = uwl_pin_in_mask(pin, snap.out_mask) ? UWL_IO_DIR_OUTPUT : UWL_IO_DIR_INPUT,
+        .reason = UWL_IO_REASON_RESYNC,
+        .source = UWL_IO_SOURCE_LOCAL,
+        .mask = snap.valid_mask,
+        .values = snap.level_mask,
+        .seq = seq ? seq : snap.seq,
+        .ts_us = esp_timer_get_time(),
     };
 }
 
-#if defined(CONFIG_UWL_ENABLE_HEADER_PRESET) && CONFIG_UWL_ENABLE_HEADER_PRESET
-static void uwl_add_header_preset_entries(void)
+static void uwl_listener_worker_task(void *arg)
 {
-    // ESP32-C6 DevKitC-1 header (J1/J3) - safe subset:
-    // - Exclude strap pins: 0,1,4,5,9,15 (can affect boot)
-    // - Exclude USB pins: 12,13 (handled by uwl_is_forbidden_pin)
-    // - Exclude status LED pin: usually GPIO8 (handled by uwl_is_forbidden_pin)
-    // - Exclude UART pins 16/17 by default (often used as console)
-    static const int out_pins[] = {
-        2, 3, 6, 7, 10, 11, 18, 19, 20, 21, 22, 23,
-    };
+    uwl_listener_t *l = (uwl_listener_t *)arg;
+    static const size_t batch_cap = CONFIG_UWL_IO_DISPATCH_BATCH_MAX;
+    uwl_io_event_t *batch = (uwl_io_event_t *)calloc(batch_cap, sizeof(uwl_io_event_t));
+    if (!batch) {
+        ESP_LOGE(TAG, "listener %s: no mem for batch buffer", l->name);
+        vTaskDelete(NULL);
+        return;
+    }
 
-    for (size_t i = 0; i < sizeof(out_pins) / sizeof(out_pins[0]); i++) {
-        uwl_add_entry(out_pins[i], UWL_IO_DIR_OUTPUT);
+    while (true) {
+        (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (true) {
+            size_t n = 0;
+            portENTER_CRITICAL(&l->mux);
+            while (n < batch_cap && l->count > 0) {
+                batch[n++] = l->ring[l->head];
+                l->head = (l->head + 1) % l->cap;
+                l->count--;
+            }
+            if (n > 0) {
+                l->delivered += (uint32_t)n;
+                l->batches++;
+            }
+            const bool resync = (n == 0) && l->resync;
+            if (resync) l->resync = false;
+            portEXIT_CRITICAL(&l->mux);
+
+            if (resync) {
+                // This listener overflowed: hand it a full snapshot once drained
+                uwl_make_resync_event(&batch[0], 0);
+                n = 1;
+            }
+            if (n == 0) break;
+
+            const int64_t lag = esp_timer_get_time() - batch[0].ts_us;
+            if (lag > 0 && (uint64_t)lag > l->max_lag_us) {
+                l->max_lag_us = lag > (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)lag;
+            }
+
+            if (l->batch_fn) {
+                l->batch_fn(batch, n, l->ctx);
+            } else if (l->fn) {
+                for (size_t k = 0; k < n; k++) l->fn(&batch[k], l->ctx);
+            }
+        }
+    }
+}
+
+static void uwl_emit_batch_from_task(const uwl_io_event_t *evts, size_t count)
+{
+    if (!evts || count == 0) return;
+
+    // Slots are append-only, so no lock is needed to walk them. A full ring
+    // makes each push a scan, so the spinlock is held per event rather than
+    // across the batch to keep interrupts masked for one scan at most.
+    const size_t n = s_listener_count;
+    for (size_t i = 0; i < n; i++) {
+        uwl_listener_t *l = &s_listeners[i];
+        for (size_t k = 0; k < count; k++) {
+            portENTER_CRITICAL(&l->mux);
+            uwl_listener_ring_push(l, &evts[k]);
+            portEXIT_CRITICAL(&l->mux);
+        }
+        xTaskNotifyGive(l->worker);
+    }
+}
+
+static void uwl_dispatch_stats_record(const uwl_io_event_t *evts, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        const unsigned r = evts[i].reason < UWL_IO_REASON_COUNT ? evts[i].reason : UWL_IO_REASON_BOOT;
+        const unsigned src = evts[i].source < UWL_IO_SOURCE_COUNT ? evts[i].source : UWL_IO_SOURCE_UNKNOWN;
+        s_dispatch_stats.by_reason[r][src]++;
+    }
+    s_dispatch_stats.batches++;
+    s_dispatch_stats.events += (uint32_t)count;
+    if (count > s_dispatch_stats.max_batch) s_dispatch_stats.max_batch = (uint32_t)count;
+
+    // Buckets: 1, 2-3, 4-7, 8-15, 16+
+    size_t b = 0;
+    while (b + 1 < UWL_IO_BATCH_HIST_BUCKETS && count >= (2U << b)) b++;
+    s_dispatch_stats.size_hist[b]++;
+}
+
+static void uwl_history_append(const uwl_io_event_t *evts, size_t count)
+{
+    xSemaphoreTake(s_hist_lock, portMAX_DELAY);
+    for (size_t i = 0; i < count; i++) {
+        if (s_hist_count == CONFIG_UWL_IO_HISTORY_LEN) {
+            const uint32_t old = s_hist[s_hist_head].seq;
+            if (uwl_seq_after(old, s_hist_evicted_seq)) s_hist_evicted_seq = old;
+            s_hist_head = (s_hist_head + 1) % CONFIG_UWL_IO_HISTORY_LEN;
+            s_hist_count--;
+        }
+        s_hist[(s_hist_head + s_hist_count) % CONFIG_UWL_IO_HISTORY_LEN] = evts[i];
+        s_hist_count++;
+    }
+    xSemaphoreGive(s_hist_lock);
+}
+
+static void uwl_io_dispatch_resync(void)
+{
+    const uint32_t in_mask = s_valid_mask & ~s_out_mask;
+    uint32_t in_levels = 0;
+    for (uint32_t m = in_mask; m; m &= m - 1U) {
+        const int pin = __builtin_ctz(m);
+        uint8_t level = 0;
+        (void)uwl_gpio_get_level(pin, &level);
+        if (level) in_levels |= 1UL << pin;
+    }
+
+    uwl_io_event_t evt;
+    const uint32_t seq = uwl_next_seq();
+    uwl_state_apply_levels(in_mask, in_levels, seq);
+    uwl_make_resync_event(&evt, seq);
+
+    s_resync_count++;
+    uwl_dispatch_stats_record(&evt, 1);
+    uwl_history_append(&evt, 1);
+    uwl_emit_batch_from_task(&evt, 1);
+}
+
+static void uwl_io_dispatcher_task(void *arg)
+{
+    (void)arg;
+    static uwl_io_event_t batch[CONFIG_UWL_IO_DISPATCH_BATCH_MAX];
+    while (true) {
+        if (xQueueReceive(s_evt_q, &batch[0], portMAX_DELAY) != pdTRUE) continue;
+
+        // Depth at wakeup, the one just received included
+        const uint32_t depth = (uint32_t)uxQueueMessagesWaiting(s_evt_q) + 1U;
+        if (depth > s_dispatch_stats.queue_hwm) s_dispatch_stats.queue_hwm = depth;
+
+        // Drain whatever else is already queued so a burst costs one delivery
+        size_t n = 1;
+        while (n < CONFIG_UWL_IO_DISPATCH_BATCH_MAX && xQueueReceive(s_evt_q, &batch[n], 0) == pdTRUE) {
+            n++;
+        }
+
+        // Keep cached snapshot consistent in one place (task context)
+        for (size_t i = 0; i < n; i++) {
+            uwl_state_apply_levels(batch[i].mask, batch[i].values, batch[i].seq);
+        }
+        uwl_dispatch_stats_record(batch, n);
+        uwl_history_append(batch, n);
+        uwl_emit_batch_from_task(batch, n);
+
+        // Events were lost upstream: once the backlog is gone, re-read inputs and
+        // push one full snapshot so no listener keeps showing a stale level.
+        if (s_resync_pending && uxQueueMessagesWaiting(s_evt_q) == 0) {
+            s_resync_pending = false;
+            uwl_io_dispatch_resync();
+        }
     }
 }
-#endif
 
 esp_err_t uwl_io_state_init(void)
 {
@@ -146,27 +454,20 @@ esp_err_t uwl_io_state_init(void)
 
     s_lock = xSemaphoreCreateMutex();
     if (!s_lock) return ESP_ERR_NO_MEM;
-
-    s_evt_q = xQueueCreate(32, sizeof(uwl_io_event_t));
+    s_hist_lock = xSemaphoreCreateMutex();
+    if (!s_hist_lock) return ESP_ERR_NO_MEM;
+    // Lets clients tell a reboot (seq restarted) from a plain reconnect
+    s_boot_id = esp_random();
+
+    const int64_t now = esp_timer_get_time();
+    uwl_rate_init(&s_src_rate[UWL_IO_SOURCE_WIFI], CONFIG_UWL_RATE_WIFI_PER_S, CONFIG_UWL_RATE_SOURCE_BURST, now);
+    uwl_rate_init(&s_src_rate[UWL_IO_SOURCE_BLE], CONFIG_UWL_RATE_BLE_PER_S, CONFIG_UWL_RATE_SOURCE_BURST, now);
+    uwl_rate_init(&s_src_rate[UWL_IO_SOURCE_USB], CONFIG_UWL_RATE_USB_PER_S, CONFIG_UWL_RATE_SOURCE_BURST, now);
+    uwl_rate_init(&s_src_rate[UWL_IO_SOURCE_HTTP], CONFIG_UWL_RATE_HTTP_PER_S, CONFIG_UWL_RATE_SOURCE_BURST, now);
+
+    s_evt_q = xQueueCreate(UWL_IO_EVT_QUEUE_LEN, sizeof(uwl_io_event_t));
     if (!s_evt_q) return ESP_ERR_NO_MEM;
 
-    // Build whitelist
-    s_entry_count = 0;
-    uwl_add_entry(CONFIG_UWL_GPIO_OUT1, UWL_IO_DIR_OUTPUT);
-    uwl_add_entry(CONFIG_UWL_GPIO_OUT2, UWL_IO_DIR_OUTPUT);
-    uwl_add_entry(CONFIG_UWL_GPIO_OUT3, UWL_IO_DIR_OUTPUT);
-    uwl_add_entry(CONFIG_UWL_GPIO_OUT4, UWL_IO_DIR_OUTPUT);
-    uwl_add_entry(CONFIG_UWL_GPIO_IN1, UWL_IO_DIR_INPUT);
-
-    #if defined(CONFIG_UWL_ENABLE_HEADER_PRESET) && CONFIG_UWL_ENABLE_HEADER_PRESET
-    uwl_add_header_preset_entries();
-    #endif
-
-    if (s_entry_count == 0) {
-        ESP_LOGE(TAG, "No GPIO entries configured");
-        return ESP_ERR_INVALID_STATE;
-    }
-
     ESP_ERROR_CHECK(uwl_gpio_init());
 
     // Configure GPIOs + read initial levels
@@ -177,6 +478,9 @@ esp_err_t uwl_io_state_init(void)
             err = uwl_gpio_config_output(pin, 0);
         } else {
             err = uwl_gpio_config_input_with_isr(pin, true, false);
+            if (err == ESP_OK && CONFIG_UWL_GPIO_IN_DEBOUNCE_US > 0) {
+                err = uwl_gpio_set_debounce(pin, CONFIG_UWL_GPIO_IN_DEBOUNCE_US, CONFIG_UWL_GPIO_IN_DEBOUNCE_SAMPLES);
+            }
         }
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "GPIO init failed pin=%d dir=%d: %s", pin, (int)s_entries[i].dir, esp_err_to_name(err));
@@ -185,21 +489,27 @@ esp_err_t uwl_io_state_init(void)
 
         uint8_t level = 0;
         (void)uwl_gpio_get_level(pin, &level);
-        s_entries[i].value = level ? 1 : 0;
+        uwl_state_apply_level(pin, level);
     }
 
     xTaskCreate(uwl_io_dispatcher_task, "uwl_io_evt", 4096, NULL, 10, NULL);
 
     // Emit boot snapshot events (optional: one per pin)
     for (size_t i = 0; i < s_entry_count; i++) {
+        const int pin = s_entries[i].pin;
+        const uint8_t value = (uint8_t)((s_level_mask >> pin) & 1U);
         const uwl_io_event_t evt = {
-            .pin = s_entries[i].pin,
-            .value = s_entries[i].value,
+            .pin = pin,
+            .value = value,
             .dir = s_entries[i].dir,
             .reason = UWL_IO_REASON_BOOT,
             .source = UWL_IO_SOURCE_LOCAL,
+            .mask = 1UL << pin,
+            .values = (uint32_t)value << pin,
+            .seq = uwl_next_seq(),
+            .ts_us = esp_timer_get_time(),
         };
-        xQueueSend(s_evt_q, &evt, 0);
+        uwl_evt_post(&evt);
     }
 
     ESP_LOGI(TAG, "io_state init ok, entries=%u", (unsigned)s_entry_count);
@@ -212,75 +522,347 @@ const uwl_io_entry_t *uwl_io_state_entries(size_t *count_out)
     return s_entries;
 }
 
-esp_err_t uwl_io_state_add_listener(uwl_io_listener_fn fn, void *ctx)
+void uwl_io_state_snapshot(uwl_io_snapshot_t *out)
 {
-    if (!fn) return ESP_ERR_INVALID_ARG;
+    if (!out) return;
+    uint32_t g0 = 0;
+    uint32_t level = 0;
+    uint32_t seq = 0;
+    do {
+        g0 = __atomic_load_n(&s_gen, __ATOMIC_ACQUIRE);
+        level = s_level_mask;
+        seq = s_applied_seq;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((g0 & 1U) != 0 || g0 != __atomic_load_n(&s_gen, __ATOMIC_RELAXED));
+
+    out->gen = g0 >> 1;
+    out->valid_mask = s_valid_mask;
+    out->out_mask = s_out_mask;
+    out->level_mask = level;
+    out->seq = seq;
+    out->poll_mask = __atomic_load_n(&s_poll_mask, __ATOMIC_RELAXED);
+}
+
+esp_err_t uwl_io_state_add_listener_ex(const uwl_io_listener_cfg_t *cfg)
+{
+    if (!cfg || (!cfg->fn && !cfg->batch_fn)) return ESP_ERR_INVALID_ARG;
     if (!s_lock) return ESP_ERR_INVALID_STATE;
 
+    const size_t cap = cfg->queue_len ? cfg->queue_len : CONFIG_UWL_IO_LISTENER_QUEUE_LEN;
+    uwl_io_event_t *ring = (uwl_io_event_t *)calloc(cap, sizeof(uwl_io_event_t));
+    if (!ring) return ESP_ERR_NO_MEM;
+
     xSemaphoreTake(s_lock, portMAX_DELAY);
-    if (s_listener_count >= (sizeof(s_listeners) / sizeof(s_listeners[0]))) {
+    const size_t idx = s_listener_count;
+    if (idx >= UWL_IO_MAX_LISTENERS) {
         xSemaphoreGive(s_lock);
+        free(ring);
         return ESP_ERR_NO_MEM;
     }
-    s_listeners[s_listener_count++] = (uwl_listener_t){ .fn = fn, .ctx = ctx };
+
+    uwl_listener_t *l = &s_listeners[idx];
+    memset(l, 0, sizeof(*l));
+    if (cfg->name) {
+        strncpy(l->name, cfg->name, sizeof(l->name) - 1);
+    } else {
+        snprintf(l->name, sizeof(l->name), "uwl_lsn%u", (unsigned)idx);
+    }
+    l->fn = cfg->fn;
+    l->batch_fn = cfg->batch_fn;
+    l->ctx = cfg->ctx;
+    l->policy = cfg->policy;
+    portMUX_INITIALIZE(&l->mux);
+    l->ring = ring;
+    l->cap = cap;
+
+    const uint32_t stack = cfg->stack_size ? cfg->stack_size : 4096;
+    const unsigned prio = cfg->task_prio ? cfg->task_prio : 8;
+    if (xTaskCreate(uwl_listener_worker_task, l->name, stack, l, prio, &l->worker) != pdPASS) {
+        xSemaphoreGive(s_lock);
+        free(ring);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Publish only once the worker exists; the dispatcher reads the count lock-free
+    __atomic_store_n(&s_listener_count, idx + 1, __ATOMIC_RELEASE);
     xSemaphoreGive(s_lock);
     return ESP_OK;
 }
 
+esp_err_t uwl_io_state_add_listener(uwl_io_listener_fn fn, void *ctx)
+{
+    if (!fn) return ESP_ERR_INVALID_ARG;
+    const uwl_io_listener_cfg_t cfg = { .fn = fn, .ctx = ctx };
+    return uwl_io_state_add_listener_ex(&cfg);
+}
+
+esp_err_t uwl_io_state_add_batch_listener(uwl_io_batch_listener_fn fn, void *ctx)
+{
+    if (!fn) return ESP_ERR_INVALID_ARG;
+    const uwl_io_listener_cfg_t cfg = { .batch_fn = fn, .ctx = ctx };
+    return uwl_io_state_add_listener_ex(&cfg);
+}
+
+size_t uwl_io_state_get_listener_stats(uwl_io_listener_stats_t *out, size_t cap)
+{
+    const size_t n = s_listener_count;
+    size_t i = 0;
+    for (; out && i < n && i < cap; i++) {
+        uwl_listener_t *l = &s_listeners[i];
+        out[i].name = l->name;
+        portENTER_CRITICAL(&l->mux);
+        out[i].delivered = l->delivered;
+        out[i].batches = l->batches;
+        out[i].dropped = l->dropped;
+        out[i].coalesced = l->coalesced;
+        out[i].pending = (uint32_t)l->count;
+        out[i].max_pending = l->max_pending;
+        out[i].max_lag_us = l->max_lag_us;
+        portEXIT_CRITICAL(&l->mux);
+    }
+    return out ? i : n;
+}
+
+void uwl_io_state_get_dispatch_stats(uwl_io_dispatch_stats_t *out)
+{
+    if (!out) return;
+    memcpy(out, &s_dispatch_stats, sizeof(*out));
+}
+
+void uwl_io_state_get_drop_stats(uwl_io_drop_stats_t *out)
+{
+    if (!out) return;
+    for (size_t i = 0; i < UWL_IO_SOURCE_COUNT; i++) {
+        out->dropped[i] = __atomic_load_n(&s_drop_by_source[i], __ATOMIC_RELAXED);
+    }
+    out->resyncs = s_resync_count;
+    out->resync_pending = s_resync_pending;
+}
+
+void uwl_io_state_get_rate_stats(uwl_io_rate_stats_t *out)
+{
+    if (!out) return;
+    for (size_t i = 0; i < UWL_IO_SOURCE_COUNT; i++) {
+        out->limited[i] = __atomic_load_n(&s_rate_limited_by_source[i], __ATOMIC_RELAXED);
+    }
+}
+
+static bool uwl_rate_source_take(uwl_io_source_t source)
+{
+    if ((unsigned)source >= UWL_IO_SOURCE_COUNT) return true;
+    portENTER_CRITICAL(&s_rate_mux);
+    // Zero-initialised buckets (LOCAL/UNKNOWN) have rate 0: unlimited
+    const bool ok = uwl_rate_take(&s_src_rate[source], esp_timer_get_time());
+    portEXIT_CRITICAL(&s_rate_mux);
+    if (!ok) __atomic_fetch_add(&s_rate_limited_by_source[source], 1U, __ATOMIC_RELAXED);
+    return ok;
+}
+
+const char *uwl_io_source_name(uwl_io_source_t source)
+{
+    switch (source) {
+    case UWL_IO_SOURCE_WIFI: return "wifi";
+    case UWL_IO_SOURCE_USB: return "usb";
+    case UWL_IO_SOURCE_BLE: return "ble";
+    case UWL_IO_SOURCE_LOCAL: return "local";
+    case UWL_IO_SOURCE_HTTP: return "http";
+    default: return "unknown";
+    }
+}
+
+const char *uwl_io_reason_name(uwl_io_reason_t reason)
+{
+    switch (reason) {
+    case UWL_IO_REASON_INPUT_EDGE: return "edge";
+    case UWL_IO_REASON_SET_CMD: return "set";
+    case UWL_IO_REASON_RESYNC: return "resync";
+    case UWL_IO_REASON_MODE: return "mode";
+    default: return "boot";
+    }
+}
+
 esp_err_t uwl_io_state_get(int pin, uint8_t *value_out)
 {
     if (!value_out) return ESP_ERR_INVALID_ARG;
-    const int idx = uwl_find_entry_idx(pin);
-    if (idx < 0) return ESP_ERR_NOT_FOUND;
-    *value_out = s_entries[idx].value;
+    if (!uwl_pin_in_mask(pin, s_valid_mask)) return ESP_ERR_NOT_FOUND;
+    // Single word: no seqlock retry needed for one pin
+    *value_out = (uint8_t)((s_level_mask >> pin) & 1U);
     return ESP_OK;
 }
 
 esp_err_t uwl_io_state_set(int pin, uint8_t value, uwl_io_source_t source)
 {
-    const int idx = uwl_find_entry_idx(pin);
-    if (idx < 0) return ESP_ERR_NOT_FOUND;
-    if (s_entries[idx].dir != UWL_IO_DIR_OUTPUT) return ESP_ERR_INVALID_STATE;
+    if (!uwl_pin_in_mask(pin, s_valid_mask)) return ESP_ERR_NOT_FOUND;
+    return uwl_io_state_set_mask(1UL << pin, value ? (1UL << pin) : 0, source);
+}
 
-    const uint8_t v = value ? 1 : 0;
-    const esp_err_t err = uwl_gpio_set_level(pin, v);
+esp_err_t uwl_io_state_set_mask(uint32_t mask, uint32_t values, uwl_io_source_t source)
+{
+    if (mask == 0) return ESP_ERR_INVALID_ARG;
+    if ((mask & ~s_valid_mask) != 0) return ESP_ERR_NOT_FOUND;
+    if ((mask & ~s_out_mask) != 0) return ESP_ERR_INVALID_STATE;
+    if (!uwl_rate_source_take(source)) return UWL_ERR_RATE_LIMITED;
+
+    values &= mask;
+    // Seq, register write and cached level in one critical section: two
+    // racing sets hit the pins in seq order, and the dispatcher later skips
+    // the levels stamped here instead of writing them a second time.
+    portENTER_CRITICAL(&s_state_mux);
+    const uint32_t seq = uwl_next_seq();
+    const esp_err_t err = uwl_gpio_set_mask(values, mask & ~values);
+    if (err == ESP_OK) uwl_state_write_levels(mask, values, seq, false);
+    portEXIT_CRITICAL(&s_state_mux);
     if (err != ESP_OK) return err;
+    const int64_t ts = esp_timer_get_time();
 
-    // Update cached value
-    s_entries[idx].value = v;
-
+    const int pin = __builtin_ctz(mask);
     const uwl_io_event_t evt = {
         .pin = pin,
-        .value = v,
-        .dir = s_entries[idx].dir,
+        .value = (uint8_t)((values >> pin) & 1U),
+        .dir = UWL_IO_DIR_OUTPUT,
         .reason = UWL_IO_REASON_SET_CMD,
         .source = source,
+        .mask = mask,
+        .values = values,
+        .seq = seq,
+        .ts_us = ts,
     };
-    xQueueSend(s_evt_q, &evt, 0);
+    uwl_evt_post(&evt);
     return ESP_OK;
 }
 
-void uwl_io_state_on_input_edge_isr(int pin, uint8_t value)
+static inline bool uwl_make_input_event(int pin, uint8_t value, int64_t ts_us, uwl_io_event_t *out)
 {
-    const int idx = uwl_find_entry_idx(pin);
-    if (idx < 0) return;
-    if (s_entries[idx].dir != UWL_IO_DIR_INPUT) return;
+    if (!uwl_pin_in_mask(pin, s_valid_mask)) return false;
+    if (uwl_pin_in_mask(pin, s_out_mask)) return false;
 
     const uint8_t v = value ? 1 : 0;
-    // Avoid spamming identical events; read cached value without locking (best-effort)
-    if (s_entries[idx].value == v) return;
-    const uwl_io_event_t evt = {
+    // Avoid spamming identical events; the dispatcher owns input level updates
+    if (((s_level_mask >> pin) & 1U) == v) return false;
+    *out = (uwl_io_event_t){
         .pin = pin,
         .value = v,
-        .dir = s_entries[idx].dir,
+        .dir = UWL_IO_DIR_INPUT,
         .reason = UWL_IO_REASON_INPUT_EDGE,
         .source = UWL_IO_SOURCE_LOCAL,
+        .mask = 1UL << pin,
+        .values = (uint32_t)v << pin,
+        .seq = uwl_next_seq(),
+        .ts_us = ts_us,
     };
+    return true;
+}
+
+void uwl_io_state_on_input_edge_isr(int pin, uint8_t value)
+{
+    uwl_io_event_t evt;
+    if (!uwl_make_input_event(pin, value, esp_timer_get_time(), &evt)) return;
 
     BaseType_t hp_task_woken = pdFALSE;
-    (void)xQueueSendFromISR(s_evt_q, &evt, &hp_task_woken);
+    if (xQueueSendFromISR(s_evt_q, &evt, &hp_task_woken) != pdTRUE) {
+        uwl_note_drop(UWL_IO_SOURCE_LOCAL);
+    }
     if (hp_task_woken == pdTRUE) {
         portYIELD_FROM_ISR();
     }
 }
 
+void uwl_io_state_on_input_settled(int pin, uint8_t value, int64_t ts_us)
+{
+    uwl_io_event_t evt;
+    if (!uwl_make_input_event(pin, value, ts_us, &evt)) return;
+    uwl_evt_post(&evt);
+}
+
+esp_err_t uwl_io_state_set_debounce(int pin, uint32_t window_us, uint8_t stable_count)
+{
+    if (!uwl_pin_in_mask(pin, s_valid_mask)) return ESP_ERR_NOT_FOUND;
+    if (uwl_pin_in_mask(pin, s_out_mask)) return ESP_ERR_INVALID_STATE;
+    if (window_us > 1000000) return ESP_ERR_INVALID_ARG;
+    return uwl_gpio_set_debounce(pin, window_us, window_us ? (stable_count ? stable_count : 1) : 0);
+}
+
+esp_err_t uwl_io_state_get_debounce(int pin, uint32_t *window_us_out, uint8_t *stable_count_out)
+{
+    if (!uwl_pin_in_mask(pin, s_valid_mask)) return ESP_ERR_NOT_FOUND;
+    uwl_gpio_debounce_info_t info;
+    const esp_err_t err = uwl_gpio_get_debounce(pin, &info);
+    if (err != ESP_OK) return err;
+    if (window_us_out) *window_us_out = info.window_us;
+    if (stable_count_out) *stable_count_out = info.stable_count;
+    return ESP_OK;
+}
+
+void uwl_io_state_on_input_mode(int pin, uwl_io_pin_mode_t mode, uint32_t edge_rate)
+{
+    if (!uwl_pin_in_mask(pin, s_valid_mask)) return;
+    if (mode == UWL_IO_PIN_MODE_POLL) {
+        __atomic_or_fetch(&s_poll_mask, 1UL << pin, __ATOMIC_RELAXED);
+    } else {
+        __atomic_and_fetch(&s_poll_mask, ~(1UL << pin), __ATOMIC_RELAXED);
+    }
+    const uwl_io_event_t evt = {
+        .pin = pin,
+        .value = (uint8_t)mode,
+        .dir = UWL_IO_DIR_INPUT,
+        .reason = UWL_IO_REASON_MODE,
+        .source = UWL_IO_SOURCE_LOCAL,
+        .mask = 0,
+        .values = edge_rate,
+        .seq = uwl_next_seq(),
+        .ts_us = esp_timer_get_time(),
+    };
+    uwl_evt_post(&evt);
+}
+
+uint32_t uwl_io_state_boot_id(void)
+{
+    return s_boot_id;
+}
+
+esp_err_t uwl_io_state_history_since(uint32_t boot_id, uint32_t since_seq,
+                                     uwl_io_event_t *out, size_t cap, size_t *count_out)
+{
+    if (!out || !count_out) return ESP_ERR_INVALID_ARG;
+    if (!s_hist_lock) return ESP_ERR_INVALID_STATE;
+    *count_out = 0;
+    if (boot_id != s_boot_id) return ESP_ERR_NOT_FOUND;
+
+    esp_err_t err = ESP_OK;
+    size_t n = 0;
+    uint32_t hi = since_seq;
+    xSemaphoreTake(s_hist_lock, portMAX_DELAY);
+    if (uwl_seq_after(s_hist_evicted_seq, since_seq)) {
+        err = ESP_ERR_NOT_FOUND; // ring wrapped past the client
+    } else {
+        for (size_t i = 0; i < s_hist_count; i++) {
+            const uwl_io_event_t *e = &s_hist[(s_hist_head + i) % CONFIG_UWL_IO_HISTORY_LEN];
+            if (!uwl_seq_after(e->seq, since_seq)) continue;
+            if (n == cap) {
+                err = ESP_ERR_INVALID_SIZE;
+                break;
+            }
+            out[n++] = *e;
+            if (uwl_seq_after(e->seq, hi)) hi = e->seq;
+        }
+    }
+    xSemaphoreGive(s_hist_lock);
+    if (err != ESP_OK) return err;
+
+    // Every seq in (since, hi] must be present: a gap is an event dropped
+    // before dispatch, which only a snapshot can repair.
+    if (hi - since_seq != (uint32_t)n) return ESP_ERR_NOT_FOUND;
+
+    // ISR and task posts can interleave, so queue order is not strictly seq order
+    for (size_t i = 1; i < n; i++) {
+        const uwl_io_event_t e = out[i];
+        size_t j = i;
+        while (j > 0 && uwl_seq_after(out[j - 1].seq, e.seq)) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        out[j] = e;
+    }
+    *count_out = n;
+    return ESP_OK;
+}
@@ -19,46 +19,167 @@ typedef enum {
     UWL_IO_REASON_BOOT = 0,
     UWL_IO_REASON_INPUT_EDGE = 1,
     UWL_IO_REASON_SET_CMD = 2,
+    UWL_IO_REASON_RESYNC = 3, // full snapshot after events were lost (mask = all pins)
+    UWL_IO_REASON_MODE = 4,   // input switched between interrupt and polling (mask = 0)
+    UWL_IO_REASON_COUNT,
 } uwl_io_reason_t;
 
+typedef enum {
+    UWL_IO_PIN_MODE_IRQ = 0,  // edges reported from the GPIO interrupt
+    UWL_IO_PIN_MODE_POLL = 1, // interrupt storm: pin sampled from a timer
+} uwl_io_pin_mode_t;
+
 typedef enum {
     UWL_IO_SOURCE_UNKNOWN = 0,
     UWL_IO_SOURCE_WIFI = 1,
     UWL_IO_SOURCE_USB = 2,
     UWL_IO_SOURCE_BLE = 3,
     UWL_IO_SOURCE_LOCAL = 4,
+    UWL_IO_SOURCE_HTTP = 5, // REST /api/gpio
+    UWL_IO_SOURCE_COUNT,
 } uwl_io_source_t;
 
+// Whitelist entry; levels live in uwl_io_snapshot_t
 typedef struct {
     int pin;
     uwl_io_dir_t dir;
-    uint8_t value; // 0/1
 } uwl_io_entry_t;
 
 typedef struct {
-    int pin;
-    uint8_t value; // 0/1
+    int pin;         // lowest pin in mask
+    uint8_t value;   // 0/1 (level of pin)
     uwl_io_dir_t dir;
     uwl_io_reason_t reason;
     uwl_io_source_t source;
+    uint32_t mask;   // all pins changed by this event (bit N = GPIO N)
+    uint32_t values; // their new levels
+                     // UWL_IO_REASON_MODE: value = uwl_io_pin_mode_t, values = measured edges/s
+    uint32_t seq;    // monotonic, assigned at capture; gaps mean lost events
+    int64_t ts_us;   // esp_timer time at capture (ISR entry / set call)
 } uwl_io_event_t;
 
+// Consistent view of all whitelisted pins; bit N describes GPIO N.
+typedef struct {
+    uint32_t gen;        // bumps on every state write
+    uint32_t valid_mask; // whitelisted pins
+    uint32_t out_mask;   // pins configured as outputs
+    uint32_t level_mask; // cached levels (1 = high)
+    uint32_t seq;        // seq of the last event applied by the dispatcher
+    uint32_t poll_mask;  // inputs currently in polling mode (storm guard)
+} uwl_io_snapshot_t;
+
+static inline bool uwl_io_event_is_multi(const uwl_io_event_t *evt)
+{
+    return (evt->mask & (evt->mask - 1U)) != 0;
+}
+
 typedef void (*uwl_io_listener_fn)(const uwl_io_event_t *evt, void *ctx);
+// Batch form: evts[0..count) in queue order, drained by one dispatcher wakeup
+typedef void (*uwl_io_batch_listener_fn)(const uwl_io_event_t *evts, size_t count, void *ctx);
+
+typedef enum {
+    UWL_IO_OVERFLOW_DROP_OLDEST = 0, // full queue: discard the oldest pending event
+    UWL_IO_OVERFLOW_COALESCE = 1,    // full queue: replace the pending event for the same pin(s), else drop oldest
+} uwl_io_overflow_policy_t;
+
+// Every listener gets its own bounded queue and worker task.
+// Zero fields fall back to defaults (Kconfig queue length, 4 KB stack, priority 8).
+typedef struct {
+    const char *name;                  // worker task name (copied)
+    uwl_io_listener_fn fn;             // one of fn / batch_fn
+    uwl_io_batch_listener_fn batch_fn;
+    void *ctx;
+    size_t queue_len;
+    uwl_io_overflow_policy_t policy;
+    uint32_t stack_size;
+    unsigned task_prio;
+} uwl_io_listener_cfg_t;
+
+typedef struct {
+    const char *name;
+    uint32_t delivered;   // events handed to the callback
+    uint32_t batches;     // callback invocations
+    uint32_t dropped;     // events lost to overflow
+    uint32_t coalesced;   // events superseded by a newer level for the same pin(s)
+    uint32_t pending;     // current lag (queued, not yet delivered)
+    uint32_t max_pending; // lag high-water mark
+    uint32_t max_lag_us;  // worst capture-to-callback latency
+} uwl_io_listener_stats_t;
+
+typedef struct {
+    uint32_t dropped[UWL_IO_SOURCE_COUNT]; // core event queue overflows, by source
+    uint32_t resyncs;                      // full snapshots pushed after overflow
+    bool resync_pending;                   // overflow seen, snapshot not yet pushed
+} uwl_io_drop_stats_t;
+
+typedef struct {
+    uint32_t limited[UWL_IO_SOURCE_COUNT]; // writes refused by the per-source token bucket
+} uwl_io_rate_stats_t;
+
+#define UWL_IO_BATCH_HIST_BUCKETS 5
+
+typedef struct {
+    uint32_t batches;    // dispatcher wakeups that delivered events
+    uint32_t events;     // events delivered in total
+    uint32_t max_batch;  // largest single batch seen
+    uint32_t size_hist[UWL_IO_BATCH_HIST_BUCKETS]; // batch sizes: 1, 2-3, 4-7, 8-15, 16+
+    uint32_t by_reason[UWL_IO_REASON_COUNT][UWL_IO_SOURCE_COUNT]; // events delivered
+    uint32_t queue_len;  // core event queue capacity
+    uint32_t queue_hwm;  // most events ever found queued at a dispatcher wakeup
+} uwl_io_dispatch_stats_t;
 
 esp_err_t uwl_io_state_init(void);
 
 // Snapshot API (read-only, pointer valid for lifetime of app)
 const uwl_io_entry_t *uwl_io_state_entries(size_t *count_out);
 
+// Lock-free consistent snapshot (safe from any task or ISR; never blocks on writers)
+void uwl_io_state_snapshot(uwl_io_snapshot_t *out);
+
 // Control/read API
 esp_err_t uwl_io_state_get(int pin, uint8_t *value_out);
 esp_err_t uwl_io_state_set(int pin, uint8_t value, uwl_io_source_t source);
 
-// Subscribe to state change events (called from an internal dispatcher task)
+// Drive every output in mask to the matching bit of values on the same edge.
+// Emits a single event covering all pins. Fails without touching any pin if
+// mask contains a non-whitelisted pin (NOT_FOUND) or an input (INVALID_STATE).
+// UWL_ERR_RATE_LIMITED (uwl_rate.h): the source's write budget is spent.
+esp_err_t uwl_io_state_set_mask(uint32_t mask, uint32_t values, uwl_io_source_t source);
+
+// Subscribe to state change events (called from the listener's own worker task)
 esp_err_t uwl_io_state_add_listener(uwl_io_listener_fn fn, void *ctx);
+esp_err_t uwl_io_state_add_batch_listener(uwl_io_batch_listener_fn fn, void *ctx);
+esp_err_t uwl_io_state_add_listener_ex(const uwl_io_listener_cfg_t *cfg);
+
+// Fills up to cap entries; returns the number written (or the listener count if out is NULL)
+size_t uwl_io_state_get_listener_stats(uwl_io_listener_stats_t *out, size_t cap);
+
+void uwl_io_state_get_dispatch_stats(uwl_io_dispatch_stats_t *out);
+void uwl_io_state_get_drop_stats(uwl_io_drop_stats_t *out);
+void uwl_io_state_get_rate_stats(uwl_io_rate_stats_t *out);
+
+const char *uwl_io_source_name(uwl_io_source_t source);
+const char *uwl_io_reason_name(uwl_io_reason_t reason);
+
+// Per-input debounce (window_us = 0 forwards every edge). Inputs only.
+esp_err_t uwl_io_state_set_debounce(int pin, uint32_t window_us, uint8_t stable_count);
+esp_err_t uwl_io_state_get_debounce(int pin, uint32_t *window_us_out, uint8_t *stable_count_out);
+
+// Random per boot; clients echo it back so a seq from before a reboot is never replayed
+uint32_t uwl_io_state_boot_id(void);
+// Copies the dispatched events newer than since_seq into out, in seq order.
+// ESP_ERR_NOT_FOUND: history no longer covers since_seq (ring wrapped, events
+// were dropped, or boot_id is stale) and the client needs a full snapshot.
+// ESP_ERR_INVALID_SIZE: more than cap events are missing.
+esp_err_t uwl_io_state_history_since(uint32_t boot_id, uint32_t since_seq,
+                                     uwl_io_event_t *out, size_t cap, size_t *count_out);
 
 // Used by GPIO ISR glue to inform input changes
 void uwl_io_state_on_input_edge_isr(int pin, uint8_t value);
+// Task-context variant for filtered inputs; ts_us is the time of the originating edge
+void uwl_io_state_on_input_settled(int pin, uint8_t value, int64_t ts_us);
+// Storm guard switched an input between interrupt and polling mode
+void uwl_io_state_on_input_mode(int pin, uwl_io_pin_mode_t mode, uint32_t edge_rate);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,83 @@
+#include "uwl_lat.h"
+
+#include <string.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+typedef struct {
+    uint32_t buckets[UWL_LAT_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+} uwl_lat_hist_t;
+
+static uwl_lat_hist_t s_hist[UWL_IO_SOURCE_COUNT][UWL_LAT_KIND_COUNT];
+static portMUX_TYPE s_lat_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static inline unsigned uwl_lat_bucket(uint32_t us)
+{
+    return us == 0 ? 0 : 31U - (unsigned)__builtin_clz(us);
+}
+
+void uwl_lat_record(uwl_io_source_t src, uwl_lat_kind_t kind, int64_t us)
+{
+    if ((unsigned)src >= UWL_IO_SOURCE_COUNT || (unsigned)kind >= UWL_LAT_KIND_COUNT) return;
+    const uint32_t v = us <= 0 ? 0 : (us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+    uwl_lat_hist_t *h = &s_hist[src][kind];
+
+    portENTER_CRITICAL(&s_lat_mux);
+    h->buckets[uwl_lat_bucket(v)]++;
+    h->count++;
+    if (v > h->max_us) h->max_us = v;
+    portEXIT_CRITICAL(&s_lat_mux);
+}
+
+void uwl_lat_record_since(uwl_io_source_t src, uwl_lat_kind_t kind, int64_t since_us)
+{
+    uwl_lat_record(src, kind, esp_timer_get_time() - since_us);
+}
+
+static uint32_t uwl_lat_percentile(const uwl_lat_hist_t *h, uint32_t permille)
+{
+    // Smallest bucket whose cumulative count reaches the rank
+    const uint64_t rank = ((uint64_t)h->count * permille + 999U) / 1000U;
+    uint64_t seen = 0;
+    for (unsigned k = 0; k < UWL_LAT_BUCKETS; k++) {
+        seen += h->buckets[k];
+        if (seen >= rank) {
+            const uint32_t upper = k >= 31 ? UINT32_MAX : (2UL << k) - 1U;
+            return upper < h->max_us ? upper : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+void uwl_lat_get(uwl_io_source_t src, uwl_lat_kind_t kind, uwl_lat_summary_t *out)
+{
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if ((unsigned)src >= UWL_IO_SOURCE_COUNT || (unsigned)kind >= UWL_LAT_KIND_COUNT) return;
+
+    uwl_lat_hist_t h;
+    portENTER_CRITICAL(&s_lat_mux);
+    h = s_hist[src][kind];
+    portEXIT_CRITICAL(&s_lat_mux);
+    if (h.count == 0) return;
+
+    out->count = h.count;
+    out->p50_us = uwl_lat_percentile(&h, 500);
+    out->p99_us = uwl_lat_percentile(&h, 990);
+    out->max_us = h.max_us;
+}
+
+void uwl_lat_reset(void)
+{
+    portENTER_CRITICAL(&s_lat_mux);
+    memset(s_hist, 0, sizeof(s_hist));
+    portEXIT_CRITICAL(&s_lat_mux);
+}
+
+const char *uwl_lat_kind_name(uwl_lat_kind_t kind)
+{
+    return kind == UWL_LAT_GPIO ? "gpio" : "ack";
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "uwl_io_state.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Command latency per channel (uwl_io_source_t), measured from the moment a
+// frame/write is received: log2 microsecond histograms, safe from any task.
+
+typedef enum {
+    UWL_LAT_GPIO = 0, // receive -> GPIO written
+    UWL_LAT_ACK,      // receive -> reply handed to the transport
+    UWL_LAT_KIND_COUNT,
+} uwl_lat_kind_t;
+
+// Bucket k holds [2^k, 2^(k+1)) us; bucket 0 also takes 0
+#define UWL_LAT_BUCKETS 32
+
+typedef struct {
+    uint32_t count;
+    uint32_t p50_us; // bucket upper bound, capped at max_us
+    uint32_t p99_us;
+    uint32_t max_us;
+} uwl_lat_summary_t;
+
+void uwl_lat_record(uwl_io_source_t src, uwl_lat_kind_t kind, int64_t us);
+// Convenience: record now - since_us
+void uwl_lat_record_since(uwl_io_source_t src, uwl_lat_kind_t kind, int64_t since_us);
+void uwl_lat_get(uwl_io_source_t src, uwl_lat_kind_t kind, uwl_lat_summary_t *out);
+void uwl_lat_reset(void);
+
+const char *uwl_lat_kind_name(uwl_lat_kind_t kind);
+
+#ifdef __cplusplus
+}
+#endif
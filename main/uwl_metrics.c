@@ -0,0 +1,216 @@
+#include "uwl_metrics.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "uwl_ble_gatt.h"
+#include "uwl_io_state.h"
+#include "uwl_sse.h"
+#include "uwl_wifi_softap.h"
+#include "uwl_ws.h"
+
+// Tasks listed per scrape; uxTaskGetSystemState wants room for all of them
+#define UWL_METRICS_MAX_TASKS 32
+
+// The handler runs on the httpd task only; output goes out in chunks of this
+static char s_out[1024];
+static size_t s_out_len;
+static esp_err_t s_out_err;
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+static TaskStatus_t s_tasks[UWL_METRICS_MAX_TASKS];
+#endif
+
+static void uwl_metrics_flush(httpd_req_t *req)
+{
+    if (s_out_len == 0 || s_out_err != ESP_OK) return;
+    s_out_err = httpd_resp_send_chunk(req, s_out, (ssize_t)s_out_len);
+    s_out_len = 0;
+}
+
+static void __attribute__((format(printf, 2, 3))) uwl_metrics_printf(httpd_req_t *req, const char *fmt, ...)
+{
+    for (int attempt = 0; attempt < 2; attempt++) {
+        const size_t room = sizeof(s_out) - s_out_len;
+        va_list ap;
+        va_start(ap, fmt);
+        const int n = vsnprintf(s_out + s_out_len, room, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < room) {
+            s_out_len += (size_t)n;
+            return;
+        }
+        // Did not fit: send what is buffered and retry on an empty buffer
+        uwl_metrics_flush(req);
+    }
+}
+
+static void uwl_metrics_head(httpd_req_t *req, const char *name, const char *type, const char *help)
+{
+    uwl_metrics_printf(req, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void uwl_metrics_u32(httpd_req_t *req, const char *name, const char *type, const char *help, uint32_t v)
+{
+    uwl_metrics_head(req, name, type, help);
+    uwl_metrics_printf(req, "%s %" PRIu32 "\n", name, v);
+}
+
+static void uwl_metrics_by_source(httpd_req_t *req, const char *name, const char *help, const uint32_t *v)
+{
+    uwl_metrics_head(req, name, "counter", help);
+    for (size_t i = 0; i < UWL_IO_SOURCE_COUNT; i++) {
+        uwl_metrics_printf(req, "%s{source=\"%s\"} %" PRIu32 "\n", name, uwl_io_source_name((uwl_io_source_t)i),
+                           v[i]);
+    }
+}
+
+static void uwl_metrics_io(httpd_req_t *req)
+{
+    uwl_io_dispatch_stats_t ds;
+    uwl_io_state_get_dispatch_stats(&ds);
+    uwl_metrics_head(req, "uwl_io_events_total", "counter", "Events dispatched to listeners");
+    for (size_t r = 0; r < UWL_IO_REASON_COUNT; r++) {
+        for (size_t s = 0; s < UWL_IO_SOURCE_COUNT; s++) {
+            uwl_metrics_printf(req, "uwl_io_events_total{reason=\"%s\",source=\"%s\"} %" PRIu32 "\n",
+                               uwl_io_reason_name((uwl_io_reason_t)r), uwl_io_source_name((uwl_io_source_t)s),
+                               ds.by_reason[r][s]);
+        }
+    }
+    uwl_metrics_u32(req, "uwl_io_dispatch_batches_total", "counter", "Dispatcher wakeups that delivered events",
+                    ds.batches);
+    uwl_metrics_u32(req, "uwl_io_queue_capacity", "gauge", "Core event queue length", ds.queue_len);
+    uwl_metrics_u32(req, "uwl_io_queue_high_water", "gauge", "Most events queued at a dispatcher wakeup",
+                    ds.queue_hwm);
+
+    uwl_io_drop_stats_t drops;
+    uwl_io_state_get_drop_stats(&drops);
+    uwl_metrics_by_source(req, "uwl_io_events_dropped_total", "Core event queue overflows", drops.dropped);
+    uwl_metrics_u32(req, "uwl_io_resyncs_total", "counter", "Full snapshots pushed after overflow", drops.resyncs);
+
+    uwl_io_rate_stats_t rate;
+    uwl_io_state_get_rate_stats(&rate);
+    uwl_metrics_by_source(req, "uwl_io_rate_limited_total", "GPIO writes refused by the per-source limit",
+                          rate.limited);
+
+    uwl_io_listener_stats_t ls[8];
+    const size_t nl = uwl_io_state_get_listener_stats(ls, sizeof(ls) / sizeof(ls[0]));
+    uwl_metrics_head(req, "uwl_io_listener_events_total", "counter", "Listener queue outcomes");
+    for (size_t i = 0; i < nl; i++) {
+        uwl_metrics_printf(req,
+                           "uwl_io_listener_events_total{listener=\"%s\",result=\"delivered\"} %" PRIu32 "\n"
+                           "uwl_io_listener_events_total{listener=\"%s\",result=\"dropped\"} %" PRIu32 "\n"
+                           "uwl_io_listener_events_total{listener=\"%s\",result=\"coalesced\"} %" PRIu32 "\n",
+                           ls[i].name, ls[i].delivered, ls[i].name, ls[i].dropped, ls[i].name, ls[i].coalesced);
+    }
+    uwl_metrics_head(req, "uwl_io_listener_max_pending", "gauge", "Listener queue high-water mark");
+    for (size_t i = 0; i < nl; i++) {
+        uwl_metrics_printf(req, "uwl_io_listener_max_pending{listener=\"%s\"} %" PRIu32 "\n", ls[i].name,
+                           ls[i].max_pending);
+    }
+    uwl_metrics_head(req, "uwl_io_listener_max_lag_us", "gauge", "Worst capture-to-callback latency");
+    for (size_t i = 0; i < nl; i++) {
+        uwl_metrics_printf(req, "uwl_io_listener_max_lag_us{listener=\"%s\"} %" PRIu32 "\n", ls[i].name,
+                           ls[i].max_lag_us);
+    }
+}
+
+static void uwl_metrics_links(httpd_req_t *req)
+{
+    uwl_metrics_u32(req, "uwl_wifi_stations", "gauge", "Stations joined to the SoftAP",
+                    (uint32_t)uwl_wifi_softap_get_sta_count());
+    uwl_metrics_u32(req, "uwl_ws_clients", "gauge", "Open WebSocket sessions", (uint32_t)uwl_ws_get_client_count());
+    uwl_metrics_u32(req, "uwl_sse_clients", "gauge", "Open /api/events streams", (uint32_t)uwl_sse_get_client_count());
+    uwl_metrics_u32(req, "uwl_ble_connected", "gauge", "BLE central connected", uwl_ble_is_connected() ? 1 : 0);
+
+    uwl_ws_tx_stats_t tx;
+    uwl_ws_get_tx_stats(&tx);
+    uwl_metrics_head(req, "uwl_ws_tx_frames_total", "counter", "WebSocket frames sent");
+    uwl_metrics_printf(req, "uwl_ws_tx_frames_total{result=\"ok\"} %" PRIu32 "\n", tx.frames);
+    uwl_metrics_printf(req, "uwl_ws_tx_frames_total{result=\"error\"} %" PRIu32 "\n", tx.errors);
+    uwl_metrics_u32(req, "uwl_ws_tx_bytes_total", "counter", "WebSocket payload bytes sent", tx.bytes);
+    uwl_metrics_u32(req, "uwl_ws_rate_limited_total", "counter", "WebSocket frames refused by the per-client limit",
+                    uwl_ws_get_rate_limited());
+    uwl_ws_keepalive_stats_t ka;
+    uwl_ws_get_keepalive_stats(&ka);
+    uwl_metrics_u32(req, "uwl_ws_pings_total", "counter", "Keepalive pings sent", ka.pings);
+    uwl_metrics_u32(req, "uwl_ws_pongs_total", "counter", "Keepalive pongs received", ka.pongs);
+    uwl_metrics_u32(req, "uwl_ws_reaped_total", "counter", "Idle WebSocket sessions closed", ka.reaped);
+
+    uwl_ble_notify_stats_t bn;
+    uwl_ble_get_notify_stats(&bn);
+    uwl_metrics_head(req, "uwl_ble_notify_total", "counter", "BLE STATE notifications");
+    uwl_metrics_printf(req, "uwl_ble_notify_total{result=\"ok\"} %" PRIu32 "\n", bn.sent);
+    uwl_metrics_printf(req, "uwl_ble_notify_total{result=\"error\"} %" PRIu32 "\n", bn.failed);
+    uwl_metrics_u32(req, "uwl_ble_rate_limited_total", "counter", "BLE writes refused by the per-client limit",
+                    uwl_ble_get_rate_limited());
+}
+
+static void uwl_metrics_system(httpd_req_t *req)
+{
+    uwl_metrics_head(req, "uwl_uptime_seconds", "counter", "Time since boot");
+    uwl_metrics_printf(req, "uwl_uptime_seconds %" PRId64 "\n", esp_timer_get_time() / 1000000);
+    uwl_metrics_u32(req, "uwl_heap_free_bytes", "gauge", "Free heap", esp_get_free_heap_size());
+    uwl_metrics_u32(req, "uwl_heap_min_free_bytes", "gauge", "Lowest free heap since boot",
+                    esp_get_minimum_free_heap_size());
+    uwl_metrics_u32(req, "uwl_heap_largest_free_block_bytes", "gauge", "Largest allocatable 8-bit block",
+                    (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    // Returns 0 when the array is too small: better no task lines than a partial list
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    const UBaseType_t nt = uxTaskGetSystemState(s_tasks, UWL_METRICS_MAX_TASKS, &total);
+    uwl_metrics_head(req, "uwl_task_stack_high_water_bytes", "gauge", "Least free stack each task has had");
+    for (UBaseType_t i = 0; i < nt; i++) {
+        uwl_metrics_printf(req, "uwl_task_stack_high_water_bytes{task=\"%s\"} %" PRIu32 "\n", s_tasks[i].pcTaskName,
+                           (uint32_t)s_tasks[i].usStackHighWaterMark);
+    }
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    // Run-time stats clock: esp_timer, so microseconds
+    uwl_metrics_head(req, "uwl_task_runtime_us_total", "counter", "CPU time spent in each task");
+    for (UBaseType_t i = 0; i < nt; i++) {
+        uwl_metrics_printf(req, "uwl_task_runtime_us_total{task=\"%s\"} %" PRIu64 "\n", s_tasks[i].pcTaskName,
+                           (uint64_t)s_tasks[i].ulRunTimeCounter);
+    }
+    uwl_metrics_head(req, "uwl_runtime_us_total", "counter", "Run-time stats clock, all tasks");
+    uwl_metrics_printf(req, "uwl_runtime_us_total %" PRIu64 "\n", (uint64_t)total);
+#endif
+#endif
+}
+
+static esp_err_t uwl_metrics_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    s_out_len = 0;
+    s_out_err = ESP_OK;
+
+    uwl_metrics_system(req);
+    uwl_metrics_links(req);
+    uwl_metrics_io(req);
+
+    uwl_metrics_flush(req);
+    if (s_out_err != ESP_OK) return s_out_err;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t uwl_metrics_register(httpd_handle_t server)
+{
+    if (!server) return ESP_ERR_INVALID_ARG;
+    httpd_uri_t metrics = {
+        .uri = "/api/metrics",
+        .method = HTTP_GET,
+        .handler = uwl_metrics_handler,
+        .user_ctx = NULL,
+    };
+    return httpd_register_uri_handler(server, &metrics);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "esp_err.h"
+
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GET /api/metrics: Prometheus text exposition of the counters the modules
+// already keep (io dispatch, queues, WS/BLE sends, rate limits), plus heap
+// and per-task stack/CPU figures. Nothing is sampled in the background; all
+// of it is read when scraped.
+esp_err_t uwl_metrics_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,88 @@
+# Generates uwl_pin_table.h (the GPIO whitelist) from sdkconfig at configure time.
+#
+# Kconfig pins (UWL_GPIO_OUT1..4, UWL_GPIO_IN1) must be distinct and must not
+# be forbidden; mistakes stop the build instead of silently dropping a pin at
+# boot. Header preset pins only fill in around them: a preset pin already
+# configured above, or forbidden, is skipped.
+
+# Conservative: avoid USB D-/D+ default pins on ESP32-C6
+set(UWL_FORBIDDEN_PINS 12 13)
+
+# ESP32-C6 DevKitC-1 header (J1/J3) - safe subset:
+# - Exclude strap pins: 0,1,4,5,9,15 (can affect boot)
+# - Exclude USB pins: 12,13 (forbidden above)
+# - Exclude status LED pin: usually GPIO8 (forbidden below when enabled)
+# - Exclude UART pins 16/17 by default (often used as console)
+set(UWL_HEADER_PRESET_OUT_PINS 2 3 6 7 10 11 18 19 20 21 22 23)
+
+function(uwl_gen_pin_table out_file)
+    # sdkconfig values are not loaded during component early expansion
+    if(CMAKE_BUILD_EARLY_EXPANSION)
+        return()
+    endif()
+
+    set(forbidden ${UWL_FORBIDDEN_PINS})
+    # Avoid clobbering the onboard status LED (WS2812 data pin) if enabled.
+    if(CONFIG_UWL_ENABLE_STATUS_LED)
+        list(APPEND forbidden ${CONFIG_UWL_STATUS_LED_GPIO})
+    endif()
+
+    set(pins "")
+    set(dirs "")
+    foreach(opt UWL_GPIO_OUT1 UWL_GPIO_OUT2 UWL_GPIO_OUT3 UWL_GPIO_OUT4 UWL_GPIO_IN1)
+        set(pin "${CONFIG_${opt}}")
+        if(NOT pin MATCHES "^[0-9]+$" OR pin GREATER 30)
+            message(FATAL_ERROR "CONFIG_${opt}='${pin}' is not a usable ESP32-C6 GPIO (0..30)")
+        endif()
+        if(pin IN_LIST forbidden)
+            message(FATAL_ERROR "CONFIG_${opt}=${pin} is reserved (USB D-/D+ or status LED)")
+        endif()
+        if(pin IN_LIST pins)
+            message(FATAL_ERROR "CONFIG_${opt}=${pin} is already used by another UWL_GPIO_* option")
+        endif()
+        list(APPEND pins ${pin})
+        if(opt MATCHES "_IN[0-9]+$")
+            list(APPEND dirs UWL_IO_DIR_INPUT)
+        else()
+            list(APPEND dirs UWL_IO_DIR_OUTPUT)
+        endif()
+    endforeach()
+
+    if(CONFIG_UWL_ENABLE_HEADER_PRESET)
+        foreach(pin ${UWL_HEADER_PRESET_OUT_PINS})
+            if(pin IN_LIST forbidden OR pin IN_LIST pins)
+                continue()
+            endif()
+            list(APPEND pins ${pin})
+            list(APPEND dirs UWL_IO_DIR_OUTPUT)
+        endforeach()
+    endif()
+
+    list(LENGTH pins count)
+    math(EXPR last "${count} - 1")
+    set(valid_mask 0)
+    set(out_mask 0)
+    set(entries "")
+    foreach(i RANGE ${last})
+        list(GET pins ${i} pin)
+        list(GET dirs ${i} dir)
+        math(EXPR valid_mask "${valid_mask} | (1 << ${pin})" OUTPUT_FORMAT HEXADECIMAL)
+        if(dir STREQUAL "UWL_IO_DIR_OUTPUT")
+            math(EXPR out_mask "${out_mask} | (1 << ${pin})" OUTPUT_FORMAT HEXADECIMAL)
+        endif()
+        string(APPEND entries "    { .pin = ${pin}, .dir = ${dir} }, \\\n")
+    endforeach()
+
+    set(content "// Generated by main/uwl_pin_table.cmake from sdkconfig. Do not edit.\n")
+    string(APPEND content "#pragma once\n\n")
+    string(APPEND content "#define UWL_PIN_TABLE_COUNT ${count}\n")
+    string(APPEND content "#define UWL_PIN_VALID_MASK ${valid_mask}UL\n")
+    string(APPEND content "#define UWL_PIN_OUT_MASK ${out_mask}UL\n\n")
+    string(APPEND content "// Initializer for const uwl_io_entry_t[UWL_PIN_TABLE_COUNT], Kconfig pins first\n")
+    string(APPEND content "#define UWL_PIN_TABLE_ENTRIES \\\n${entries}\n")
+
+    # Only touch the header when the table changes, so unrelated sdkconfig
+    # edits do not rebuild everything that includes it.
+    file(WRITE "${out_file}.tmp" "${content}")
+    configure_file("${out_file}.tmp" "${out_file}" COPYONLY)
+endfunction()
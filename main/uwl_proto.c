@@ -0,0 +1,690 @@
+#include "uwl_proto.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---- writer ----
+
+void uwl_proto_writer_init(uwl_proto_writer_t *w, char *buf, size_t cap)
+{
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->comma = false;
+    w->overflow = (buf == NULL || cap == 0);
+}
+
+static void uwl_w_put(uwl_proto_writer_t *w, const char *s, size_t n)
+{
+    // Keep one byte for the terminating NUL
+    if (w->overflow || w->len + n >= w->cap) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+static inline void uwl_w_ch(uwl_proto_writer_t *w, char c)
+{
+    uwl_w_put(w, &c, 1);
+}
+
+static void uwl_w_escaped(uwl_proto_writer_t *w, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    uwl_w_ch(w, '"');
+    for (; s && *s; s++) {
+        const unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            const char esc[2] = { '\\', (char)c };
+            uwl_w_put(w, esc, 2);
+        } else if (c < 0x20) {
+            const char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+            uwl_w_put(w, esc, 6);
+        } else {
+            uwl_w_ch(w, (char)c);
+        }
+    }
+    uwl_w_ch(w, '"');
+}
+
+static void uwl_w_key(uwl_proto_writer_t *w, const char *key)
+{
+    if (w->comma) uwl_w_ch(w, ',');
+    w->comma = true;
+    if (!key) return;
+    uwl_w_ch(w, '"');
+    uwl_w_put(w, key, strlen(key));
+    uwl_w_put(w, "\":", 2);
+}
+
+static void uwl_w_u64(uwl_proto_writer_t *w, uint64_t v)
+{
+    char tmp[20];
+    size_t n = 0;
+    do {
+        tmp[sizeof(tmp) - 1 - n++] = (char)('0' + (v % 10U));
+        v /= 10U;
+    } while (v && n < sizeof(tmp));
+    uwl_w_put(w, tmp + sizeof(tmp) - n, n);
+}
+
+void uwl_proto_obj_begin(uwl_proto_writer_t *w, const char *key)
+{
+    uwl_w_key(w, key);
+    uwl_w_ch(w, '{');
+    w->comma = false;
+}
+
+void uwl_proto_obj_end(uwl_proto_writer_t *w)
+{
+    uwl_w_ch(w, '}');
+    w->comma = true;
+}
+
+void uwl_proto_arr_begin(uwl_proto_writer_t *w, const char *key)
+{
+    uwl_w_key(w, key);
+    uwl_w_ch(w, '[');
+    w->comma = false;
+}
+
+void uwl_proto_arr_end(uwl_proto_writer_t *w)
+{
+    uwl_w_ch(w, ']');
+    w->comma = true;
+}
+
+void uwl_proto_str(uwl_proto_writer_t *w, const char *key, const char *val)
+{
+    uwl_w_key(w, key);
+    uwl_w_escaped(w, val);
+}
+
+void uwl_proto_u32(uwl_proto_writer_t *w, const char *key, uint32_t val)
+{
+    uwl_w_key(w, key);
+    uwl_w_u64(w, val);
+}
+
+void uwl_proto_i64(uwl_proto_writer_t *w, const char *key, int64_t val)
+{
+    uwl_w_key(w, key);
+    if (val < 0) {
+        uwl_w_ch(w, '-');
+        uwl_w_u64(w, (uint64_t)0 - (uint64_t)val);
+    } else {
+        uwl_w_u64(w, (uint64_t)val);
+    }
+}
+
+void uwl_proto_bool(uwl_proto_writer_t *w, const char *key, bool val)
+{
+    uwl_w_key(w, key);
+    if (val) {
+        uwl_w_put(w, "true", 4);
+    } else {
+        uwl_w_put(w, "false", 5);
+    }
+}
+
+int uwl_proto_finish(uwl_proto_writer_t *w)
+{
+    if (w->overflow) {
+        if (w->buf && w->cap) w->buf[0] = '\0';
+        return -1;
+    }
+    w->buf[w->len] = '\0';
+    return (int)w->len;
+}
+
+// ---- messages ----
+
+void uwl_proto_resp_begin(uwl_proto_writer_t *w, int id, bool with_data)
+{
+    uwl_proto_obj_begin(w, NULL);
+    uwl_proto_str(w, "type", "resp");
+    if (id >= 0) uwl_proto_i64(w, "id", id);
+    uwl_proto_bool(w, "ok", true);
+    if (with_data) uwl_proto_obj_begin(w, "data");
+}
+
+int uwl_proto_resp_end(uwl_proto_writer_t *w, bool with_data)
+{
+    return uwl_proto_resp_end_us(w, with_data, -1);
+}
+
+int uwl_proto_resp_end_us(uwl_proto_writer_t *w, bool with_data, int64_t us)
+{
+    if (with_data) uwl_proto_obj_end(w);
+    if (us >= 0) uwl_proto_i64(w, "us", us);
+    uwl_proto_obj_end(w);
+    return uwl_proto_finish(w);
+}
+
+int uwl_proto_encode_status(char *buf, size_t cap, const uwl_status_t *st)
+{
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, cap);
+    uwl_proto_obj_begin(&w, NULL);
+    uwl_proto_str(&w, "type", "status");
+    uwl_proto_i64(&w, "sta_count", st->sta_count);
+    uwl_proto_u32(&w, "ws_clients", (uint32_t)st->ws_clients);
+    uwl_proto_bool(&w, "ble_connected", st->ble_connected);
+    uwl_proto_bool(&w, "ble_notify", st->ble_notify);
+    uwl_proto_obj_end(&w);
+    return uwl_proto_finish(&w);
+}
+
+int uwl_proto_encode_err(char *buf, size_t cap, int id, const char *code, const char *msg)
+{
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, cap);
+    uwl_proto_obj_begin(&w, NULL);
+    uwl_proto_str(&w, "type", "err");
+    if (id >= 0) uwl_proto_i64(&w, "id", id);
+    if (code) uwl_proto_str(&w, "code", code);
+    if (msg) uwl_proto_str(&w, "msg", msg);
+    uwl_proto_obj_end(&w);
+    return uwl_proto_finish(&w);
+}
+
+static inline const char *uwl_dir_name(uwl_io_dir_t dir)
+{
+    return dir == UWL_IO_DIR_OUTPUT ? "out" : "in";
+}
+
+int uwl_proto_encode_state(char *buf, size_t cap)
+{
+    size_t count = 0;
+    const uwl_io_entry_t *entries = uwl_io_state_entries(&count);
+    uwl_io_snapshot_t snap;
+    uwl_io_state_snapshot(&snap);
+
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, cap);
+    uwl_proto_obj_begin(&w, NULL);
+    uwl_proto_str(&w, "type", "state");
+    uwl_proto_u32(&w, "boot", uwl_io_state_boot_id());
+    uwl_proto_u32(&w, "seq", snap.seq);
+    uwl_proto_arr_begin(&w, "gpios");
+    for (size_t i = 0; i < count; i++) {
+        const int pin = entries[i].pin;
+        uwl_proto_obj_begin(&w, NULL);
+        uwl_proto_i64(&w, "pin", pin);
+        uwl_proto_str(&w, "dir", uwl_dir_name(entries[i].dir));
+        uwl_proto_u32(&w, "value", (snap.level_mask >> pin) & 1U);
+        uint32_t deb_us = 0;
+        uint8_t deb_n = 0;
+        if (entries[i].dir == UWL_IO_DIR_INPUT && uwl_io_state_get_debounce(pin, &deb_us, &deb_n) == ESP_OK) {
+            uwl_proto_u32(&w, "deb_us", deb_us);
+            uwl_proto_u32(&w, "deb_n", deb_n);
+            uwl_proto_str(&w, "mode", ((snap.poll_mask >> pin) & 1U) ? "poll" : "irq");
+        }
+        uwl_proto_obj_end(&w);
+    }
+    uwl_proto_arr_end(&w);
+    uwl_proto_obj_end(&w);
+    return uwl_proto_finish(&w);
+}
+
+int uwl_proto_encode_gpio(char *buf, size_t cap, int pin, uint8_t value, int id)
+{
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, cap);
+    uwl_proto_obj_begin(&w, NULL);
+    uwl_proto_str(&w, "type", "gpio");
+    uwl_proto_i64(&w, "pin", pin);
+    uwl_proto_u32(&w, "value", value ? 1 : 0);
+    if (id >= 0) uwl_proto_i64(&w, "id", id);
+    uwl_proto_obj_end(&w);
+    return uwl_proto_finish(&w);
+}
+
+int uwl_proto_encode_mode(char *buf, size_t cap, const uwl_io_event_t *evt)
+{
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, cap);
+    uwl_proto_obj_begin(&w, NULL);
+    uwl_proto_str(&w, "type", "gpio_mode");
+    uwl_proto_i64(&w, "pin", evt->pin);
+    uwl_proto_str(&w, "mode", evt->value == UWL_IO_PIN_MODE_POLL ? "poll" : "irq");
+    uwl_proto_u32(&w, "rate", evt->values);
+    uwl_proto_u32(&w, "seq", evt->seq);
+    uwl_proto_i64(&w, "ts", evt->ts_us);
+    uwl_proto_obj_end(&w);
+    return uwl_proto_finish(&w);
+}
+
+int uwl_proto_encode_resync_mask(char *buf, size_t cap)
+{
+    uwl_io_snapshot_t snap;
+    uwl_io_state_snapshot(&snap);
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, cap);
+    uwl_proto_obj_begin(&w, NULL);
+    uwl_proto_str(&w, "type", "resync");
+    uwl_proto_u32(&w, "boot", uwl_io_state_boot_id());
+    uwl_proto_u32(&w, "seq", snap.seq);
+    uwl_proto_u32(&w, "mask", snap.valid_mask);
+    uwl_proto_u32(&w, "out", snap.out_mask);
+    uwl_proto_u32(&w, "values", snap.level_mask);
+    uwl_proto_obj_end(&w);
+    return uwl_proto_finish(&w);
+}
+
+static int uwl_proto_encode_changed_one(char *buf, size_t cap, const uwl_io_event_t *evt, uint32_t pin_mask)
+{
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, cap);
+    uwl_proto_obj_begin(&w, NULL);
+    uwl_proto_str(&w, "type", "gpio_changed");
+    if (uwl_io_event_is_multi(evt)) {
+        // Coalesced multi-pin write: one frame, one entry per subscribed pin
+        const uint32_t mask = evt->mask & pin_mask;
+        uwl_proto_u32(&w, "mask", mask);
+        uwl_proto_u32(&w, "values", evt->values & mask);
+        uwl_proto_arr_begin(&w, "changes");
+        for (uint32_t m = mask; m; m &= m - 1U) {
+            const int pin = __builtin_ctz(m);
+            uwl_proto_obj_begin(&w, NULL);
+            uwl_proto_i64(&w, "pin", pin);
+            uwl_proto_u32(&w, "value", (evt->values >> pin) & 1U);
+            uwl_proto_str(&w, "dir", uwl_dir_name(evt->dir));
+            uwl_proto_obj_end(&w);
+        }
+        uwl_proto_arr_end(&w);
+    } else {
+        uwl_proto_i64(&w, "pin", evt->pin);
+        uwl_proto_u32(&w, "value", evt->value ? 1 : 0);
+        uwl_proto_str(&w, "dir", uwl_dir_name(evt->dir));
+    }
+    uwl_proto_str(&w, "reason", uwl_io_reason_name(evt->reason));
+    uwl_proto_u32(&w, "seq", evt->seq);
+    uwl_proto_i64(&w, "ts", evt->ts_us);
+    uwl_proto_obj_end(&w);
+    return uwl_proto_finish(&w);
+}
+
+int uwl_proto_encode_changed(char *buf, size_t cap, const uwl_io_event_t *evts, size_t count, uint32_t pin_mask,
+                             size_t *consumed)
+{
+    *consumed = count;
+    if (count == 0) return 0;
+    if (count == 1) {
+        if (evts[0].reason == UWL_IO_REASON_MODE || (evts[0].mask & pin_mask) == 0) return 0;
+        return uwl_proto_encode_changed_one(buf, cap, &evts[0], pin_mask);
+    }
+
+    // One frame per dispatcher batch, one entry per changed pin in queue order
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, cap);
+    uwl_proto_obj_begin(&w, NULL);
+    uwl_proto_str(&w, "type", "gpio_changed");
+    uwl_proto_arr_begin(&w, "changes");
+
+    size_t entries = 0;
+    size_t i = 0;
+    for (; i < count; i++) {
+        const uwl_io_event_t *evt = &evts[i];
+        if (evt->reason == UWL_IO_REASON_MODE) continue;
+        const size_t mark = w.len;
+        const bool mark_comma = w.comma;
+        size_t added = 0;
+        for (uint32_t m = evt->mask & pin_mask; m; m &= m - 1U) {
+            const int pin = __builtin_ctz(m);
+            uwl_proto_obj_begin(&w, NULL);
+            uwl_proto_i64(&w, "pin", pin);
+            uwl_proto_u32(&w, "value", (evt->values >> pin) & 1U);
+            uwl_proto_str(&w, "dir", uwl_dir_name(evt->dir));
+            uwl_proto_str(&w, "reason", uwl_io_reason_name(evt->reason));
+            uwl_proto_u32(&w, "seq", evt->seq);
+            uwl_proto_i64(&w, "ts", evt->ts_us);
+            uwl_proto_obj_end(&w);
+            added++;
+        }
+        // Room left for the closing "]}"?
+        if (w.overflow || w.len + 3 > w.cap) {
+            if (entries == 0) {
+                // Does not fit even on its own: skip it rather than stall
+                *consumed = i + 1;
+                return -1;
+            }
+            w.len = mark;
+            w.comma = mark_comma;
+            w.overflow = false;
+            break;
+        }
+        entries += added;
+    }
+    *consumed = i;
+    if (entries == 0) return 0;
+    uwl_proto_arr_end(&w);
+    uwl_proto_obj_end(&w);
+    return uwl_proto_finish(&w);
+}
+
+const char *uwl_proto_err_code(esp_err_t err)
+{
+    if (err == ESP_OK) return "OK";
+    if (err == ESP_ERR_NOT_FOUND) return "NOT_FOUND";
+    if (err == ESP_ERR_INVALID_STATE) return "NOT_OUTPUT";
+    if (err == ESP_ERR_INVALID_ARG) return "BAD_ARG";
+    if (err == ESP_ERR_NO_MEM) return "NO_MEM";
+    if (err == ESP_ERR_NOT_SUPPORTED) return "NOT_SUPPORTED";
+    if (err == UWL_ERR_RATE_LIMITED) return "RATE_LIMITED";
+    return "FAIL";
+}
+
+// ---- uwl.bin ----
+
+static inline void uwl_put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void uwl_put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t uwl_get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+size_t uwl_proto_bin_put(uint8_t *buf, size_t cap, const uwl_proto_bin_rec_t *rec)
+{
+    if (!buf || cap < UWL_PROTO_BIN_HDR_LEN) return 0;
+    buf[0] = rec->op;
+    buf[1] = rec->arg;
+    uwl_put_le16(buf + 2, rec->id);
+    uwl_put_le32(buf + 4, rec->mask);
+    uwl_put_le32(buf + 8, rec->values);
+    uwl_put_le32(buf + 12, rec->seq);
+    return UWL_PROTO_BIN_HDR_LEN;
+}
+
+size_t uwl_proto_bin_put_state(uint8_t *buf, size_t cap, uint16_t id)
+{
+    if (cap < UWL_PROTO_BIN_STATE_LEN) return 0;
+    uwl_io_snapshot_t snap;
+    uwl_io_state_snapshot(&snap);
+    const uwl_proto_bin_rec_t rec = {
+        .op = UWL_PROTO_BIN_OP_STATE_REC,
+        .id = id,
+        .mask = snap.valid_mask,
+        .values = snap.level_mask,
+        .seq = snap.seq,
+    };
+    (void)uwl_proto_bin_put(buf, cap, &rec);
+    uwl_put_le32(buf + 16, snap.out_mask);
+    uwl_put_le32(buf + 20, snap.poll_mask);
+    uwl_put_le32(buf + 24, uwl_io_state_boot_id());
+    uwl_put_le32(buf + 28, 0);
+    return UWL_PROTO_BIN_STATE_LEN;
+}
+
+size_t uwl_proto_bin_put_events(uint8_t *buf, size_t cap, const uwl_io_event_t *evts, size_t count,
+                                uint32_t pin_mask, size_t *consumed)
+{
+    size_t len = 0;
+    size_t i = 0;
+    for (; i < count; i++) {
+        const uwl_io_event_t *evt = &evts[i];
+        if (evt->reason == UWL_IO_REASON_RESYNC) continue;
+        const bool mode = evt->reason == UWL_IO_REASON_MODE;
+        const uint32_t mask = (mode ? (1UL << evt->pin) : evt->mask) & pin_mask;
+        if (mask == 0) continue;
+        if (cap - len < UWL_PROTO_BIN_EVT_LEN) break;
+        const uwl_proto_bin_rec_t rec = {
+            .op = mode ? UWL_PROTO_BIN_OP_MODE : UWL_PROTO_BIN_OP_CHANGED,
+            .arg = mode ? evt->value : (uint8_t)evt->reason,
+            .mask = mask,
+            .values = mode ? evt->values : (evt->values & mask),
+            .seq = evt->seq,
+        };
+        len += uwl_proto_bin_put(buf + len, cap - len, &rec);
+        uwl_put_le32(buf + len, (uint32_t)evt->ts_us);
+        uwl_put_le32(buf + len + 4, (uint32_t)((uint64_t)evt->ts_us >> 32));
+        len += 8;
+    }
+    *consumed = i;
+    return len;
+}
+
+esp_err_t uwl_proto_bin_next(const uint8_t *buf, size_t len, size_t *off, uwl_proto_bin_rec_t *out)
+{
+    if (*off >= len) return ESP_ERR_NOT_FOUND;
+    if (len - *off < UWL_PROTO_BIN_HDR_LEN) return ESP_ERR_INVALID_SIZE;
+    const uint8_t *p = buf + *off;
+    out->op = p[0];
+    out->arg = p[1];
+    out->id = (uint16_t)(p[2] | (p[3] << 8));
+    out->mask = uwl_get_le32(p + 4);
+    out->values = uwl_get_le32(p + 8);
+    out->seq = uwl_get_le32(p + 12);
+    *off += UWL_PROTO_BIN_HDR_LEN;
+    return ESP_OK;
+}
+
+uint8_t uwl_proto_bin_err(esp_err_t err)
+{
+    if (err == ESP_ERR_NOT_FOUND) return UWL_PROTO_BIN_ERR_NOT_FOUND;
+    if (err == ESP_ERR_INVALID_STATE) return UWL_PROTO_BIN_ERR_NOT_OUTPUT;
+    if (err == ESP_ERR_INVALID_ARG) return UWL_PROTO_BIN_ERR_BAD_ARG;
+    if (err == ESP_ERR_NO_MEM) return UWL_PROTO_BIN_ERR_NO_MEM;
+    if (err == ESP_ERR_NOT_SUPPORTED) return UWL_PROTO_BIN_ERR_NOT_SUPPORTED;
+    if (err == UWL_ERR_RATE_LIMITED) return UWL_PROTO_BIN_ERR_RATE_LIMITED;
+    return UWL_PROTO_BIN_ERR_FAIL;
+}
+
+// ---- command tokenizer ----
+
+typedef struct {
+    const char *p;
+    const char *end;
+} uwl_tok_t;
+
+static void uwl_tok_ws(uwl_tok_t *t)
+{
+    while (t->p < t->end && (*t->p == ' ' || *t->p == '\t' || *t->p == '\r' || *t->p == '\n')) t->p++;
+}
+
+static inline bool uwl_tok_peek(uwl_tok_t *t, char c)
+{
+    uwl_tok_ws(t);
+    return t->p < t->end && *t->p == c;
+}
+
+// Copies the string at t->p (opening quote included) into out, truncated to
+// cap-1 bytes; escapes are kept verbatim (keys and types never use them).
+static bool uwl_tok_string(uwl_tok_t *t, char *out, size_t cap)
+{
+    if (t->p >= t->end || *t->p != '"') return false;
+    t->p++;
+    size_t n = 0;
+    while (t->p < t->end && *t->p != '"') {
+        if (*t->p == '\\') {
+            if (out && n + 1 < cap) out[n++] = *t->p;
+            t->p++;
+            if (t->p >= t->end) return false;
+        }
+        if (out && n + 1 < cap) out[n++] = *t->p;
+        t->p++;
+    }
+    if (t->p >= t->end) return false;
+    t->p++;
+    if (out && cap) out[n] = '\0';
+    return true;
+}
+
+static bool uwl_tok_number(uwl_tok_t *t, int64_t *out)
+{
+    const char *s = t->p;
+    bool neg = false;
+    if (t->p < t->end && *t->p == '-') {
+        neg = true;
+        t->p++;
+    }
+    if (t->p >= t->end || *t->p < '0' || *t->p > '9') return false;
+    uint64_t v = 0;
+    while (t->p < t->end && *t->p >= '0' && *t->p <= '9') {
+        if (v < (UINT64_MAX / 10U) - 10U) v = v * 10U + (uint64_t)(*t->p - '0');
+        t->p++;
+    }
+    bool is_float = false;
+    while (t->p < t->end && (*t->p == '.' || *t->p == 'e' || *t->p == 'E' || *t->p == '+' || *t->p == '-' ||
+                             (*t->p >= '0' && *t->p <= '9'))) {
+        is_float = true;
+        t->p++;
+    }
+    if (is_float) {
+        // Rare (e.g. 1e3): defer to strtod on a bounded copy
+        char tmp[32];
+        const size_t n = (size_t)(t->p - s) < sizeof(tmp) - 1 ? (size_t)(t->p - s) : sizeof(tmp) - 1;
+        memcpy(tmp, s, n);
+        tmp[n] = '\0';
+        const double d = strtod(tmp, NULL);
+        *out = d >= 9.2e18 ? INT64_MAX : (d <= -9.2e18 ? INT64_MIN : (int64_t)d);
+        return true;
+    }
+    if (v > (uint64_t)INT64_MAX) v = (uint64_t)INT64_MAX;
+    *out = neg ? -(int64_t)v : (int64_t)v;
+    return true;
+}
+
+static bool uwl_tok_literal(uwl_tok_t *t, const char *lit)
+{
+    const size_t n = strlen(lit);
+    if ((size_t)(t->end - t->p) < n || memcmp(t->p, lit, n) != 0) return false;
+    t->p += n;
+    return true;
+}
+
+// Skips any value, nested containers included
+static bool uwl_tok_skip_value(uwl_tok_t *t)
+{
+    uwl_tok_ws(t);
+    if (t->p >= t->end) return false;
+    const char c = *t->p;
+    if (c == '"') return uwl_tok_string(t, NULL, 0);
+    if (c == '{' || c == '[') {
+        int depth = 0;
+        while (t->p < t->end) {
+            const char d = *t->p;
+            if (d == '"') {
+                if (!uwl_tok_string(t, NULL, 0)) return false;
+                continue;
+            }
+            if (d == '{' || d == '[') depth++;
+            if (d == '}' || d == ']') depth--;
+            t->p++;
+            if (depth == 0) return true;
+        }
+        return false;
+    }
+    int64_t ignored;
+    if (uwl_tok_number(t, &ignored)) return true;
+    return uwl_tok_literal(t, "true") || uwl_tok_literal(t, "false") || uwl_tok_literal(t, "null");
+}
+
+static int uwl_proto_field_for_key(const char *k)
+{
+    static const struct {
+        const char *key;
+        uwl_proto_field_t field;
+    } map[] = {
+        { "i", UWL_PROTO_F_ID },      { "id", UWL_PROTO_F_ID },
+        { "p", UWL_PROTO_F_PIN },     { "pin", UWL_PROTO_F_PIN },
+        { "v", UWL_PROTO_F_VALUE },   { "value", UWL_PROTO_F_VALUE },
+        { "values", UWL_PROTO_F_VALUE },
+        { "m", UWL_PROTO_F_MASK },    { "mask", UWL_PROTO_F_MASK },
+        { "w", UWL_PROTO_F_WINDOW },  { "window_us", UWL_PROTO_F_WINDOW },
+        { "n", UWL_PROTO_F_COUNT },   { "count", UWL_PROTO_F_COUNT },
+        { "s", UWL_PROTO_F_SINCE },   { "since", UWL_PROTO_F_SINCE },
+        { "b", UWL_PROTO_F_BOOT },    { "boot", UWL_PROTO_F_BOOT },
+        { "a", UWL_PROTO_F_ATOMIC },  { "atomic", UWL_PROTO_F_ATOMIC },
+    };
+    for (size_t i = 0; i < sizeof(map) / sizeof(map[0]); i++) {
+        if (strcmp(k, map[i].key) == 0) return (int)map[i].field;
+    }
+    return -1;
+}
+
+esp_err_t uwl_proto_parse_cmd(const char *json, size_t len, uwl_proto_cmd_t *out)
+{
+    if (!json || !out) return ESP_ERR_INVALID_ARG;
+    memset(out, 0, sizeof(*out));
+    uwl_tok_t t = { .p = json, .end = json + len };
+
+    if (!uwl_tok_peek(&t, '{')) return ESP_ERR_INVALID_ARG;
+    t.p++;
+    if (uwl_tok_peek(&t, '}')) return ESP_OK;
+
+    while (true) {
+        char key[12];
+        uwl_tok_ws(&t);
+        if (!uwl_tok_string(&t, key, sizeof(key))) return ESP_ERR_INVALID_ARG;
+        if (!uwl_tok_peek(&t, ':')) return ESP_ERR_INVALID_ARG;
+        t.p++;
+        uwl_tok_ws(&t);
+        if (t.p >= t.end) return ESP_ERR_INVALID_ARG;
+
+        const int f = uwl_proto_field_for_key(key);
+        if ((strcmp(key, "t") == 0 || strcmp(key, "type") == 0) && *t.p == '"') {
+            if (!uwl_tok_string(&t, out->type, sizeof(out->type))) return ESP_ERR_INVALID_ARG;
+        } else if ((strcmp(key, "c") == 0 || strcmp(key, "cmds") == 0) && *t.p == '[') {
+            // Batch: keep the span, elements are parsed one by one later
+            const char *start = t.p;
+            if (!uwl_tok_skip_value(&t)) return ESP_ERR_INVALID_ARG;
+            out->list = start;
+            out->list_len = (size_t)(t.p - start);
+        } else if (f >= 0 && (*t.p == '-' || (*t.p >= '0' && *t.p <= '9'))) {
+            if (!uwl_tok_number(&t, &out->num[f])) return ESP_ERR_INVALID_ARG;
+            out->present |= 1UL << f;
+        } else if (f >= 0 && (*t.p == 't' || *t.p == 'f')) {
+            const bool v = *t.p == 't';
+            if (!uwl_tok_literal(&t, v ? "true" : "false")) return ESP_ERR_INVALID_ARG;
+            out->num[f] = v ? 1 : 0;
+            out->present |= 1UL << f;
+        } else if (!uwl_tok_skip_value(&t)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        if (uwl_tok_peek(&t, ',')) {
+            t.p++;
+            continue;
+        }
+        if (uwl_tok_peek(&t, '}')) return ESP_OK;
+        return ESP_ERR_INVALID_ARG;
+    }
+}
+
+esp_err_t uwl_proto_list_next(const uwl_proto_cmd_t *c, size_t *off, const char **elem, size_t *elem_len)
+{
+    if (!c->list) return ESP_ERR_NOT_FOUND;
+    uwl_tok_t t = { .p = c->list + *off, .end = c->list + c->list_len };
+    if (*off == 0) {
+        if (!uwl_tok_peek(&t, '[')) return ESP_ERR_INVALID_ARG;
+        t.p++;
+    } else if (uwl_tok_peek(&t, ',')) {
+        t.p++;
+    }
+    if (uwl_tok_peek(&t, ']')) return ESP_ERR_NOT_FOUND;
+    if (t.p >= t.end) return ESP_ERR_INVALID_ARG;
+
+    const char *start = t.p;
+    if (!uwl_tok_skip_value(&t)) return ESP_ERR_INVALID_ARG;
+    *elem = start;
+    *elem_len = (size_t)(t.p - start);
+    if (!uwl_tok_peek(&t, ',') && !uwl_tok_peek(&t, ']')) return ESP_ERR_INVALID_ARG;
+    *off = (size_t)(t.p - c->list);
+    return ESP_OK;
+}
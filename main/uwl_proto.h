@@ -0,0 +1,202 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "uwl_io_state.h"
+#include "uwl_pin_table.h"
+#include "uwl_rate.h"
+#include "uwl_status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Shared WS/BLE wire format: a JSON writer over caller-provided buffers and a
+// tokenizer for the flat v2 command objects, plus the uwl.bin record codec.
+// Nothing here touches the heap.
+
+// Longest single gpios[] / changes[] entry, comma included
+#define UWL_PROTO_ENTRY_MAX_LEN 96
+// Enough for a full state snapshot of every whitelisted pin
+#define UWL_PROTO_STATE_BUF_LEN (80 + UWL_PROTO_ENTRY_MAX_LEN * UWL_PIN_TABLE_COUNT)
+// Acks, errors, gpio_mode, resync
+#define UWL_PROTO_SMALL_BUF_LEN 192
+
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+    bool comma;    // next member needs a separator
+    bool overflow; // sticky: output is truncated and must not be sent
+} uwl_proto_writer_t;
+
+void uwl_proto_writer_init(uwl_proto_writer_t *w, char *buf, size_t cap);
+// key == NULL inside arrays
+void uwl_proto_obj_begin(uwl_proto_writer_t *w, const char *key);
+void uwl_proto_obj_end(uwl_proto_writer_t *w);
+void uwl_proto_arr_begin(uwl_proto_writer_t *w, const char *key);
+void uwl_proto_arr_end(uwl_proto_writer_t *w);
+void uwl_proto_str(uwl_proto_writer_t *w, const char *key, const char *val);
+void uwl_proto_u32(uwl_proto_writer_t *w, const char *key, uint32_t val);
+void uwl_proto_i64(uwl_proto_writer_t *w, const char *key, int64_t val);
+void uwl_proto_bool(uwl_proto_writer_t *w, const char *key, bool val);
+// NUL-terminates; returns the length, or -1 if anything did not fit
+int uwl_proto_finish(uwl_proto_writer_t *w);
+
+// {"type":"resp","id":N,"ok":true[,"data":{...}]}: add data members between begin and end
+void uwl_proto_resp_begin(uwl_proto_writer_t *w, int id, bool with_data);
+int uwl_proto_resp_end(uwl_proto_writer_t *w, bool with_data);
+// Same, plus "us": receive-to-reply processing time (left out when us < 0)
+int uwl_proto_resp_end_us(uwl_proto_writer_t *w, bool with_data, int64_t us);
+
+// {"type":"status","sta_count":N,...}
+int uwl_proto_encode_status(char *buf, size_t cap, const uwl_status_t *st);
+int uwl_proto_encode_err(char *buf, size_t cap, int id, const char *code, const char *msg);
+int uwl_proto_encode_state(char *buf, size_t cap);
+// Legacy single-pin read reply: {"type":"gpio","pin":P,"value":V[,"id":N]}
+int uwl_proto_encode_gpio(char *buf, size_t cap, int pin, uint8_t value, int id);
+// Storm guard mode switch (UWL_IO_REASON_MODE); never part of gpio_changed
+int uwl_proto_encode_mode(char *buf, size_t cap, const uwl_io_event_t *evt);
+// Bitmask snapshot for links too small for the full state
+int uwl_proto_encode_resync_mask(char *buf, size_t cap);
+// gpio_changed for evts[0..count), limited to the pins in pin_mask (a client's
+// subscription). Mode events are skipped. A batch that does not fit is cut at
+// an event boundary: *consumed tells the caller where to continue with the
+// next frame. Returns 0 when there was nothing to encode.
+int uwl_proto_encode_changed(char *buf, size_t cap, const uwl_io_event_t *evts, size_t count, uint32_t pin_mask,
+                             size_t *consumed);
+
+const char *uwl_proto_err_code(esp_err_t err);
+
+// Command fields; long and short key names map to the same slot
+typedef enum {
+    UWL_PROTO_F_ID = 0, // "id" / "i"
+    UWL_PROTO_F_PIN,    // "pin" / "p"
+    UWL_PROTO_F_VALUE,  // "value" / "values" / "v"
+    UWL_PROTO_F_MASK,   // "mask" / "m"
+    UWL_PROTO_F_WINDOW, // "window_us" / "w"
+    UWL_PROTO_F_COUNT,  // "count" / "n"
+    UWL_PROTO_F_SINCE,  // "since" / "s"
+    UWL_PROTO_F_BOOT,   // "boot" / "b"
+    UWL_PROTO_F_ATOMIC, // "atomic" / "a"
+    UWL_PROTO_F_MAX,
+} uwl_proto_field_t;
+
+typedef struct {
+    char type[24];   // "type" / "t"; empty if missing
+    uint32_t present; // bit per uwl_proto_field_t
+    int64_t num[UWL_PROTO_F_MAX];
+    const char *list; // "cmds" / "c" array span in the parsed input, NULL if missing
+    size_t list_len;
+} uwl_proto_cmd_t;
+
+// Parses one flat JSON object. Unknown keys (and nested values) are skipped.
+// ESP_ERR_INVALID_ARG: not a well-formed object.
+esp_err_t uwl_proto_parse_cmd(const char *json, size_t len, uwl_proto_cmd_t *out);
+
+// Walks the elements of c->list; start with *off = 0. Each element can be fed
+// back to uwl_proto_parse_cmd. ESP_ERR_NOT_FOUND at the end of the list,
+// ESP_ERR_INVALID_ARG if the list is malformed.
+esp_err_t uwl_proto_list_next(const uwl_proto_cmd_t *c, size_t *off, const char **elem, size_t *elem_len);
+
+static inline bool uwl_proto_has(const uwl_proto_cmd_t *c, uwl_proto_field_t f)
+{
+    return (c->present & (1UL << f)) != 0;
+}
+
+static inline int64_t uwl_proto_get(const uwl_proto_cmd_t *c, uwl_proto_field_t f, int64_t defv)
+{
+    return uwl_proto_has(c, f) ? c->num[f] : defv;
+}
+
+// Clamped to int range
+static inline int uwl_proto_get_int(const uwl_proto_cmd_t *c, uwl_proto_field_t f, int defv)
+{
+    const int64_t v = uwl_proto_get(c, f, defv);
+    return v > INT32_MAX ? INT32_MAX : (v < INT32_MIN ? INT32_MIN : (int)v);
+}
+
+// Masks and seqs: negative means absent
+static inline uint32_t uwl_proto_get_u32(const uwl_proto_cmd_t *c, uwl_proto_field_t f, uint32_t defv)
+{
+    const int64_t v = uwl_proto_get(c, f, -1);
+    return v < 0 ? defv : (uint32_t)v;
+}
+
+// ---- uwl.bin: binary WS subprotocol ----
+//
+// Same commands and pushes as the v2 JSON protocol in fixed little-endian
+// records, several per frame. Every record starts with this 16-byte header:
+//
+//   0 u8  op      uwl_proto_bin_op_t
+//   1 u8  arg     per op (reason, mode, error code, flags)
+//   2 u16 id      request id, echoed in RESP/ERR; 0 on pushes
+//   4 u32 mask    pin bitmask
+//   8 u32 values  levels, or the op's value
+//  12 u32 seq     event seq, or the op's second value
+//
+// CHANGED and MODE append i64 ts_us; STATE appends u32 out, poll and boot
+// plus 4 reserved bytes. Requests are always bare 16-byte headers.
+
+#define UWL_PROTO_BIN_SUBPROTOCOL "uwl.bin"
+#define UWL_PROTO_BIN_HDR_LEN 16
+#define UWL_PROTO_BIN_EVT_LEN 24
+#define UWL_PROTO_BIN_STATE_LEN 32
+
+typedef enum {
+    // requests
+    UWL_PROTO_BIN_OP_SET = 0x01,      // "s": mask = one pin, values = level in that bit
+    UWL_PROTO_BIN_OP_SET_MASK = 0x02, // "m"
+    UWL_PROTO_BIN_OP_GET = 0x03,      // "g": mask = pins; RESP values = their levels
+    UWL_PROTO_BIN_OP_STATE = 0x04,    // "state"/"l": STATE record, then RESP
+    UWL_PROTO_BIN_OP_DEBOUNCE = 0x05, // "db": mask = one pin; arg bit0 set: values = window_us, seq = count
+    UWL_PROTO_BIN_OP_SYNC = 0x06,     // "sync": values = boot, seq = since; RESP values = n, arg bit0 = full
+    UWL_PROTO_BIN_OP_SUB = 0x07,      // "sub": mask = pins to receive pushes for
+    // replies and pushes
+    UWL_PROTO_BIN_OP_RESP = 0x80,     // ok; mask/values/seq as the JSON resp data
+    UWL_PROTO_BIN_OP_ERR = 0x81,      // arg = uwl_proto_bin_err_t
+    UWL_PROTO_BIN_OP_CHANGED = 0x90,  // arg = reason, mask/values/seq of one event
+    UWL_PROTO_BIN_OP_MODE = 0x91,     // arg = uwl_io_pin_mode_t, mask = pin, values = edges/s
+    UWL_PROTO_BIN_OP_STATE_REC = 0x92, // mask = valid, values = levels, seq = last applied
+} uwl_proto_bin_op_t;
+
+typedef enum {
+    UWL_PROTO_BIN_ERR_NOT_FOUND = 1,
+    UWL_PROTO_BIN_ERR_NOT_OUTPUT,
+    UWL_PROTO_BIN_ERR_BAD_ARG,
+    UWL_PROTO_BIN_ERR_NO_MEM,
+    UWL_PROTO_BIN_ERR_NOT_SUPPORTED,
+    UWL_PROTO_BIN_ERR_FAIL,
+    UWL_PROTO_BIN_ERR_BAD_CMD,
+    UWL_PROTO_BIN_ERR_RATE_LIMITED,
+} uwl_proto_bin_err_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t arg;
+    uint16_t id;
+    uint32_t mask;
+    uint32_t values;
+    uint32_t seq;
+} uwl_proto_bin_rec_t;
+
+// Appends one header-only record; returns bytes written, 0 if it does not fit
+size_t uwl_proto_bin_put(uint8_t *buf, size_t cap, const uwl_proto_bin_rec_t *rec);
+size_t uwl_proto_bin_put_state(uint8_t *buf, size_t cap, uint16_t id);
+// CHANGED/MODE records for evts[0..count) touching pin_mask; RESYNC events
+// are the caller's job. Stops at the first event that does not fit and
+// reports it via *consumed.
+size_t uwl_proto_bin_put_events(uint8_t *buf, size_t cap, const uwl_io_event_t *evts, size_t count,
+                                uint32_t pin_mask, size_t *consumed);
+// Reads the request record at *off and advances it.
+// ESP_ERR_NOT_FOUND: no records left; ESP_ERR_INVALID_SIZE: trailing partial record.
+esp_err_t uwl_proto_bin_next(const uint8_t *buf, size_t len, size_t *off, uwl_proto_bin_rec_t *out);
+uint8_t uwl_proto_bin_err(esp_err_t err);
+
+#ifdef __cplusplus
+}
+#endif
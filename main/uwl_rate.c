@@ -0,0 +1,32 @@
+#include "uwl_rate.h"
+
+#define UWL_RATE_UNIT 1000000ULL
+
+void uwl_rate_init(uwl_rate_bucket_t *b, uint32_t rate, uint32_t burst, int64_t now_us)
+{
+    if (!b) return;
+    b->rate = rate;
+    b->burst = burst > 0 ? burst : 1;
+    b->level = (uint64_t)b->burst * UWL_RATE_UNIT;
+    b->last_us = now_us;
+}
+
+bool uwl_rate_take(uwl_rate_bucket_t *b, int64_t now_us)
+{
+    if (!b || b->rate == 0) return true;
+
+    const uint64_t cap = (uint64_t)b->burst * UWL_RATE_UNIT;
+    if (now_us > b->last_us) {
+        // elapsed_us * rate is in the same 1e-6 token units as level; clamp
+        // the gap first so a long idle period cannot overflow
+        uint64_t elapsed = (uint64_t)(now_us - b->last_us);
+        if (elapsed > cap) elapsed = cap;
+        b->level += elapsed * b->rate;
+        if (b->level > cap) b->level = cap;
+        b->last_us = now_us;
+    }
+
+    if (b->level < UWL_RATE_UNIT) return false;
+    b->level -= UWL_RATE_UNIT;
+    return true;
+}
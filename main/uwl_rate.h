@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Command refused by a token bucket; app-private, outside the IDF error ranges.
+// Reported as "RATE_LIMITED" on the wire.
+#define UWL_ERR_RATE_LIMITED 0x7101
+
+// Token bucket: refills at rate tokens/s up to burst. Not thread-safe: the
+// owner serializes access (one task, or its own lock).
+typedef struct {
+    uint32_t rate;   // tokens per second; 0 = unlimited
+    uint32_t burst;
+    uint64_t level;  // tokens * 1e6
+    int64_t last_us;
+} uwl_rate_bucket_t;
+
+// Starts full
+void uwl_rate_init(uwl_rate_bucket_t *b, uint32_t rate, uint32_t burst, int64_t now_us);
+// Takes one token; false if none is left
+bool uwl_rate_take(uwl_rate_bucket_t *b, int64_t now_us);
+
+#ifdef __cplusplus
+}
+#endif
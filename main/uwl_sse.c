@@ -0,0 +1,378 @@
+#include "uwl_sse.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "uwl_io_state.h"
+#include "uwl_proto.h"
+#include "uwl_status.h"
+
+static const char *TAG = "uwl_sse";
+
+#ifndef CONFIG_UWL_IO_HISTORY_LEN
+#define CONFIG_UWL_IO_HISTORY_LEN 64
+#endif
+#ifndef CONFIG_UWL_SSE_MAX_CLIENTS
+#define CONFIG_UWL_SSE_MAX_CLIENTS 2
+#endif
+#ifndef CONFIG_UWL_SSE_KEEPALIVE_S
+#define CONFIG_UWL_SSE_KEEPALIVE_S 15
+#endif
+
+// "event: gpio_changed\nid: <u32>:<u32>\ndata: " and the closing blank line
+#define UWL_SSE_FIELDS_MAX 64
+// Consecutive events are packed into one chunk up to this size
+#define UWL_SSE_OUT_LEN (UWL_SSE_FIELDS_MAX + UWL_PROTO_STATE_BUF_LEN)
+#define UWL_SSE_SMALL_OUT_LEN (UWL_SSE_FIELDS_MAX + UWL_PROTO_SMALL_BUF_LEN)
+// s_lock is never held across a send, so this only waits out table updates
+#define UWL_SSE_LOCK_WAIT_MS 100
+
+typedef struct {
+    // Guarded by s_lock
+    httpd_req_t *req; // async copy of the GET; NULL = free slot
+    int fd;
+    uint32_t pins;    // ?pins= filter for gpio_changed / gpio_mode
+    uint8_t refs;     // senders using req outside s_lock
+    bool dead;        // a send failed; the last reference frees the slot
+    // Guarded by the slot's s_tx
+    bool catchup;       // skip_upto applies (connect catch-up not yet followed by a live batch)
+    uint32_t skip_upto; // newest seq the catch-up or state already covered
+} uwl_sse_client_t;
+
+// Per sending task: encode buffer and the chunk being filled
+typedef struct {
+    char *enc;
+    size_t enc_cap;
+    char *out;
+    size_t out_cap;
+    size_t len;
+    httpd_req_t *req;
+} uwl_sse_writer_t;
+
+// s_lock guards the client table only and is never held while writing to a
+// socket: the httpd task (connect) must not wait behind a stuck stream. Each
+// slot's s_tx mutex keeps the io listener worker, the keepalive task and the
+// connect catch-up from interleaving chunks on one stream; a slow client
+// only holds up senders to itself.
+static SemaphoreHandle_t s_lock;
+static SemaphoreHandle_t s_tx[CONFIG_UWL_SSE_MAX_CLIENTS];
+static uwl_sse_client_t s_clients[CONFIG_UWL_SSE_MAX_CLIENTS];
+static size_t s_client_count;
+static httpd_handle_t s_server;
+
+// io listener worker
+static char s_evt_enc[UWL_PROTO_STATE_BUF_LEN];
+static char s_evt_out[UWL_SSE_OUT_LEN];
+static uwl_sse_writer_t s_evt_w = { s_evt_enc, sizeof(s_evt_enc), s_evt_out, sizeof(s_evt_out), 0, NULL };
+// httpd task (connect catch-up)
+static char s_conn_enc[UWL_PROTO_STATE_BUF_LEN];
+static char s_conn_out[UWL_SSE_OUT_LEN];
+static uwl_sse_writer_t s_conn_w = { s_conn_enc, sizeof(s_conn_enc), s_conn_out, sizeof(s_conn_out), 0, NULL };
+static uwl_io_event_t s_catchup_evts[CONFIG_UWL_IO_HISTORY_LEN];
+// keepalive task (status and comment lines only)
+static char s_ka_enc[UWL_PROTO_SMALL_BUF_LEN];
+static char s_ka_out[UWL_SSE_SMALL_OUT_LEN];
+static uwl_sse_writer_t s_ka_w = { s_ka_enc, sizeof(s_ka_enc), s_ka_out, sizeof(s_ka_out), 0, NULL };
+
+size_t uwl_sse_get_client_count(void)
+{
+    return __atomic_load_n(&s_client_count, __ATOMIC_RELAXED);
+}
+
+static void uwl_sse_writer_begin(uwl_sse_writer_t *w, httpd_req_t *req)
+{
+    w->len = 0;
+    w->req = req;
+}
+
+static bool uwl_sse_flush(uwl_sse_writer_t *w)
+{
+    if (w->len == 0) return true;
+    const esp_err_t err = httpd_resp_send_chunk(w->req, w->out, (ssize_t)w->len);
+    w->len = 0;
+    return err == ESP_OK;
+}
+
+// Appends one event; with_id = false leaves the client's Last-Event-ID alone
+static bool uwl_sse_put(uwl_sse_writer_t *w, const char *event, bool with_id, uint32_t seq, int n)
+{
+    char fields[UWL_SSE_FIELDS_MAX];
+    const int h = with_id ? snprintf(fields, sizeof(fields), "event: %s\nid: %" PRIu32 ":%" PRIu32 "\ndata: ", event,
+                                     uwl_io_state_boot_id(), seq)
+                          : snprintf(fields, sizeof(fields), "event: %s\ndata: ", event);
+    if (h < 0 || (size_t)h >= sizeof(fields) || n <= 0) return true;
+
+    const size_t need = (size_t)h + (size_t)n + 2;
+    if (w->len + need > w->out_cap && !uwl_sse_flush(w)) return false;
+    if (need > w->out_cap) return true;
+    memcpy(w->out + w->len, fields, (size_t)h);
+    memcpy(w->out + w->len + h, w->enc, (size_t)n);
+    memcpy(w->out + w->len + h + n, "\n\n", 2);
+    w->len += need;
+    return true;
+}
+
+static bool uwl_sse_put_state(uwl_sse_writer_t *w, uint32_t seq)
+{
+    return uwl_sse_put(w, "state", true, seq, uwl_proto_encode_state(w->enc, w->enc_cap));
+}
+
+static bool uwl_sse_put_status(uwl_sse_writer_t *w, const uwl_status_t *st)
+{
+    return uwl_sse_put(w, "status", false, 0, uwl_proto_encode_status(w->enc, w->enc_cap, st));
+}
+
+// One event per message so that every id names exactly one seq. Events do
+// not arrive in seq order (ISR and task posts interleave), so nothing is
+// filtered by a running maximum: only the first live batch after connect
+// drops what the catch-up already sent. Caller holds the slot's s_tx.
+static bool uwl_sse_put_events(uwl_sse_writer_t *w, uwl_sse_client_t *c, const uwl_io_event_t *evts, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        const uwl_io_event_t *e = &evts[i];
+        bool ok = true;
+        if (e->reason == UWL_IO_REASON_RESYNC) {
+            // A listener overflow resync carries seq 0: never deduplicated
+            ok = uwl_sse_put_state(w, e->seq);
+        } else if (c->catchup && (int32_t)(e->seq - c->skip_upto) <= 0) {
+            continue;
+        } else if (e->reason == UWL_IO_REASON_MODE) {
+            if ((c->pins >> e->pin) & 1U) {
+                ok = uwl_sse_put(w, "gpio_mode", true, e->seq, uwl_proto_encode_mode(w->enc, w->enc_cap, e));
+            }
+        } else {
+            size_t used = 0;
+            ok = uwl_sse_put(w, "gpio_changed", true, e->seq,
+                             uwl_proto_encode_changed(w->enc, w->enc_cap, e, 1, c->pins, &used));
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+// Caller holds s_lock and the slot has no senders left. Completing the async
+// request hands the socket back to httpd, which then closes it.
+static void uwl_sse_free(uwl_sse_client_t *c)
+{
+    ESP_LOGI(TAG, "event stream fd=%d closed", c->fd);
+    (void)httpd_req_async_handler_complete(c->req);
+    (void)httpd_sess_trigger_close(s_server, c->fd);
+    c->req = NULL;
+    c->dead = false;
+    __atomic_store_n(&s_client_count, s_client_count - 1, __ATOMIC_RELAXED);
+}
+
+// References every live slot; the slot and its req stay valid until released
+static size_t uwl_sse_acquire(size_t *idx)
+{
+    size_t n = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_UWL_SSE_MAX_CLIENTS; i++) {
+        if (!s_clients[i].req || s_clients[i].dead) continue;
+        s_clients[i].refs++;
+        idx[n++] = i;
+    }
+    xSemaphoreGive(s_lock);
+    return n;
+}
+
+static void uwl_sse_release(size_t i, bool ok)
+{
+    uwl_sse_client_t *c = &s_clients[i];
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!ok) c->dead = true;
+    if (--c->refs == 0 && c->dead) uwl_sse_free(c);
+    xSemaphoreGive(s_lock);
+}
+
+static void uwl_sse_on_io_batch(const uwl_io_event_t *evts, size_t count, void *ctx)
+{
+    (void)ctx;
+    if (!evts || count == 0 || uwl_sse_get_client_count() == 0) return;
+
+    size_t idx[CONFIG_UWL_SSE_MAX_CLIENTS];
+    const size_t n = uwl_sse_acquire(idx);
+    for (size_t k = 0; k < n; k++) {
+        uwl_sse_client_t *c = &s_clients[idx[k]];
+        xSemaphoreTake(s_tx[idx[k]], portMAX_DELAY);
+        uwl_sse_writer_begin(&s_evt_w, c->req);
+        const bool ok = uwl_sse_put_events(&s_evt_w, c, evts, count) && uwl_sse_flush(&s_evt_w);
+        c->catchup = false;
+        xSemaphoreGive(s_tx[idx[k]]);
+        uwl_sse_release(idx[k], ok);
+    }
+}
+
+// Status pushes on change; otherwise a comment line every keepalive period,
+// which is also how a vanished client is noticed and its socket freed.
+static void uwl_sse_task(void *arg)
+{
+    (void)arg;
+    (void)uwl_status_subscribe(NULL);
+    uwl_status_t last = { 0 };
+
+    while (true) {
+        const bool changed = uwl_status_wait(pdMS_TO_TICKS(CONFIG_UWL_SSE_KEEPALIVE_S * 1000));
+        if (uwl_sse_get_client_count() == 0) continue;
+        uwl_status_t st;
+        uwl_status_get(&st);
+        if (changed && uwl_status_equal(&st, &last)) continue;
+        last = st;
+
+        size_t idx[CONFIG_UWL_SSE_MAX_CLIENTS];
+        const size_t n = uwl_sse_acquire(idx);
+        for (size_t k = 0; k < n; k++) {
+            xSemaphoreTake(s_tx[idx[k]], portMAX_DELAY);
+            uwl_sse_writer_begin(&s_ka_w, s_clients[idx[k]].req);
+            bool ok = true;
+            if (changed) {
+                ok = uwl_sse_put_status(&s_ka_w, &st);
+            } else {
+                memcpy(s_ka_w.out, ":\n\n", 3);
+                s_ka_w.len = 3;
+            }
+            ok = ok && uwl_sse_flush(&s_ka_w);
+            xSemaphoreGive(s_tx[idx[k]]);
+            uwl_sse_release(idx[k], ok);
+        }
+    }
+}
+
+static esp_err_t uwl_sse_busy(httpd_req_t *req)
+{
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "10");
+    return httpd_resp_send(req, "too many event streams", HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t uwl_sse_handler(httpd_req_t *req)
+{
+    // /api/events?pins=<mask>, decimal or 0x-hex
+    uint32_t pins = UINT32_MAX;
+    char query[48];
+    char val[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "pins", val, sizeof(val)) == ESP_OK) {
+        pins = strtoul(val, NULL, 0);
+    }
+
+    // Last-Event-ID "<boot>:<seq>" as sent in our ids
+    bool resume = false;
+    uint32_t boot_id = 0;
+    uint32_t since_seq = 0;
+    char last_id[32];
+    if (httpd_req_get_hdr_value_str(req, "Last-Event-ID", last_id, sizeof(last_id)) == ESP_OK) {
+        char *end = NULL;
+        boot_id = strtoul(last_id, &end, 10);
+        if (end && *end == ':') {
+            since_seq = strtoul(end + 1, NULL, 10);
+            resume = true;
+        }
+    }
+
+    if (xSemaphoreTake(s_lock, pdMS_TO_TICKS(UWL_SSE_LOCK_WAIT_MS)) != pdTRUE) return uwl_sse_busy(req);
+    size_t slot = CONFIG_UWL_SSE_MAX_CLIENTS;
+    for (size_t i = 0; i < CONFIG_UWL_SSE_MAX_CLIENTS && slot == CONFIG_UWL_SSE_MAX_CLIENTS; i++) {
+        if (!s_clients[i].req && s_clients[i].refs == 0) slot = i;
+    }
+    if (slot == CONFIG_UWL_SSE_MAX_CLIENTS) {
+        xSemaphoreGive(s_lock);
+        ESP_LOGW(TAG, "event stream table full");
+        return uwl_sse_busy(req);
+    }
+
+    // From here on the stream lives outside the httpd task; the handler
+    // returns once the catch-up is written and httpd keeps serving others.
+    httpd_req_t *async = NULL;
+    if (httpd_req_async_handler_begin(req, &async) != ESP_OK) {
+        xSemaphoreGive(s_lock);
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no memory for event stream");
+    }
+    uwl_sse_client_t *c = &s_clients[slot];
+    c->req = async;
+    c->fd = httpd_req_to_sockfd(req);
+    c->pins = pins;
+    c->dead = false;
+    c->refs = 1;
+    // Live batches for this slot wait on s_tx until the catch-up is out. The
+    // slot was free, so nobody else holds it.
+    xSemaphoreTake(s_tx[slot], portMAX_DELAY);
+    c->catchup = false;
+    __atomic_store_n(&s_client_count, s_client_count + 1, __ATOMIC_RELAXED);
+    xSemaphoreGive(s_lock);
+
+    httpd_resp_set_type(async, "text/event-stream");
+    httpd_resp_set_hdr(async, "Cache-Control", "no-cache");
+
+    // The slot is already listed, so events dispatched from now on reach it
+    // live; the first live batch skips what this catch-up covers.
+    uwl_sse_writer_begin(&s_conn_w, async);
+    size_t n = 0;
+    uint32_t covered;
+    bool ok;
+    if (resume && uwl_io_state_history_since(boot_id, since_seq, s_catchup_evts, CONFIG_UWL_IO_HISTORY_LEN, &n) ==
+                      ESP_OK) {
+        // Sorted by seq: the last one is the newest
+        covered = n > 0 ? s_catchup_evts[n - 1].seq : since_seq;
+        ok = uwl_sse_put_events(&s_conn_w, c, s_catchup_evts, n);
+    } else {
+        uwl_io_snapshot_t snap;
+        uwl_io_state_snapshot(&snap);
+        covered = snap.seq;
+        ok = uwl_sse_put_state(&s_conn_w, snap.seq);
+    }
+    uwl_status_t st;
+    uwl_status_get(&st);
+    ok = ok && uwl_sse_put_status(&s_conn_w, &st) && uwl_sse_flush(&s_conn_w);
+    c->skip_upto = covered;
+    c->catchup = true;
+    xSemaphoreGive(s_tx[slot]);
+
+    if (ok) {
+        ESP_LOGI(TAG, "event stream fd=%d open (pins=0x%08" PRIx32 ", %s)", c->fd, pins,
+                 resume ? "resumed" : "fresh");
+    }
+    uwl_sse_release(slot, ok);
+    return ESP_OK;
+}
+
+esp_err_t uwl_sse_register(httpd_handle_t server)
+{
+    if (!server) return ESP_ERR_INVALID_ARG;
+    s_server = server;
+
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) return ESP_ERR_NO_MEM;
+        for (size_t i = 0; i < CONFIG_UWL_SSE_MAX_CLIENTS; i++) {
+            s_tx[i] = xSemaphoreCreateMutex();
+            if (!s_tx[i]) return ESP_ERR_NO_MEM;
+        }
+
+        const uwl_io_listener_cfg_t lcfg = {
+            .name = "uwl_sse_tx",
+            .batch_fn = uwl_sse_on_io_batch,
+            .policy = UWL_IO_OVERFLOW_COALESCE,
+        };
+        esp_err_t err = uwl_io_state_add_listener_ex(&lcfg);
+        if (err != ESP_OK) return err;
+        if (xTaskCreate(uwl_sse_task, "uwl_sse_ka", 3072, NULL, 5, NULL) != pdPASS) return ESP_ERR_NO_MEM;
+    }
+
+    httpd_uri_t events = {
+        .uri = "/api/events",
+        .method = HTTP_GET,
+        .handler = uwl_sse_handler,
+        .user_ctx = NULL,
+    };
+    return httpd_register_uri_handler(server, &events);
+}
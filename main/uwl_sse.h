@@ -0,0 +1,25 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GET /api/events: Server-Sent Events for clients that cannot hold a
+// WebSocket (curl, scripts, some embedded browsers). Streams the same JSON as
+// the WS push (state, gpio_changed, gpio_mode, status), one event per line.
+//
+// ?pins=<mask> limits gpio_changed / gpio_mode to those pins. Every GPIO event
+// carries id "<boot>:<seq>", so a reconnect with Last-Event-ID gets only the
+// events it missed, or a fresh state when the history cannot cover the gap.
+esp_err_t uwl_sse_register(httpd_handle_t server);
+
+size_t uwl_sse_get_client_count(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,56 @@
+#include "uwl_status.h"
+
+#include "uwl_ble_gatt.h"
+#include "uwl_wifi_softap.h"
+#include "uwl_ws.h"
+
+// WS status push, status LED, and room to spare
+#define UWL_STATUS_MAX_SUBSCRIBERS 4
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_subs[UWL_STATUS_MAX_SUBSCRIBERS];
+static size_t s_sub_count = 0;
+
+void uwl_status_get(uwl_status_t *out)
+{
+    if (!out) return;
+    out->sta_count = uwl_wifi_softap_get_sta_count();
+    out->ws_clients = uwl_ws_get_client_count();
+    out->ble_connected = uwl_ble_is_connected();
+    out->ble_notify = uwl_ble_is_state_notify_enabled();
+}
+
+bool uwl_status_equal(const uwl_status_t *a, const uwl_status_t *b)
+{
+    return a->sta_count == b->sta_count && a->ws_clients == b->ws_clients &&
+           a->ble_connected == b->ble_connected && a->ble_notify == b->ble_notify;
+}
+
+void uwl_status_changed(void)
+{
+    TaskHandle_t subs[UWL_STATUS_MAX_SUBSCRIBERS];
+    portENTER_CRITICAL(&s_lock);
+    const size_t n = s_sub_count;
+    for (size_t i = 0; i < n; i++) subs[i] = s_subs[i];
+    portEXIT_CRITICAL(&s_lock);
+
+    for (size_t i = 0; i < n; i++) xTaskNotifyGive(subs[i]);
+}
+
+esp_err_t uwl_status_subscribe(TaskHandle_t task)
+{
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    esp_err_t err = ESP_ERR_NO_MEM;
+    portENTER_CRITICAL(&s_lock);
+    if (s_sub_count < UWL_STATUS_MAX_SUBSCRIBERS) {
+        s_subs[s_sub_count++] = task;
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return err;
+}
+
+bool uwl_status_wait(TickType_t timeout)
+{
+    return ulTaskNotifyTake(pdTRUE, timeout) > 0;
+}
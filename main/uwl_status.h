@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Link status shown by the LED and pushed to WS clients. Producers (Wi-Fi
+// station join/leave, WS session open/close, BLE connect/subscribe) call
+// uwl_status_changed(); consumer tasks subscribe and sleep until notified
+// instead of polling the counters.
+
+typedef struct {
+    int sta_count;
+    size_t ws_clients;
+    bool ble_connected;
+    bool ble_notify;
+} uwl_status_t;
+
+void uwl_status_get(uwl_status_t *out);
+bool uwl_status_equal(const uwl_status_t *a, const uwl_status_t *b);
+
+// Any task; wakes every subscriber. Bursts collapse into one wakeup.
+void uwl_status_changed(void);
+
+// task == NULL: the calling task. Uses the task's default notification.
+esp_err_t uwl_status_subscribe(TaskHandle_t task);
+// Blocks the subscribed calling task; true if woken by a change, false on timeout
+bool uwl_status_wait(TickType_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
@@ -39,9 +39,7 @@ static inline esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t a, int b) { (v
 #define ESP_LOGE(tag, fmt, ...) (void)0
 #endif
 
-#include "uwl_ble_gatt.h"
-#include "uwl_wifi_softap.h"
-#include "uwl_ws.h"
+#include "uwl_status.h"
 
 static const char *TAG = "uwl_led";
 
@@ -163,6 +161,7 @@ static void status_led_task(void *arg)
     (void)arg;
     const TickType_t period = pdMS_TO_TICKS(50);
     uint32_t tick = 0;
+    (void)uwl_status_subscribe(NULL);
 
     // Boot animation: blue breathe for ~2s
     for (int i = 0; i < 40; i++) {
@@ -172,29 +171,32 @@ static void status_led_task(void *arg)
     }
 
     while (true) {
-        const int sta = uwl_wifi_softap_get_sta_count();
-        const size_t ws = uwl_ws_get_client_count();
-        const bool ble_conn = uwl_ble_is_connected();
+        uwl_status_t st;
+        uwl_status_get(&st);
 
         // Priority:
         // 1) BLE connected: purple solid
         // 2) WS active: cyan breathing
         // 3) WiFi client connected: green solid (bright)
         // 4) idle SoftAP: green dim breathing slow
-        if (ble_conn) {
+        // Solid colours sleep until the status changes; only breathing needs frames.
+        TickType_t wait = period;
+        if (st.ble_connected) {
             set_rgb(160, 0, 160);
-        } else if (ws > 0) {
+            wait = portMAX_DELAY;
+        } else if (st.ws_clients > 0) {
             const float k = breathe((float)(tick % 40) / 40.0f);
             set_rgb(0, (uint8_t)(180 * k), (uint8_t)(180 * k)); // cyan breathe
-        } else if (sta > 0) {
+        } else if (st.sta_count > 0) {
             set_rgb(0, 255, 0);
+            wait = portMAX_DELAY;
         } else {
             const float k = breathe((float)(tick % 80) / 80.0f);
             set_rgb(0, (uint8_t)(120 * k), 0);
         }
 
         tick++;
-        vTaskDelay(period);
+        (void)uwl_status_wait(wait);
     }
 }
 
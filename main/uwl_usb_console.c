@@ -2,12 +2,17 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "esp_console.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "uwl_ble_gatt.h"
+#include "uwl_gpio.h"
+#include "uwl_http.h"
+#include "uwl_lat.h"
 #include "uwl_io_state.h"
 #include "uwl_wifi_softap.h"
 #include "uwl_ws.h"
@@ -17,22 +22,28 @@ static esp_console_repl_t *s_repl = NULL;
 
 static int uwl_cmd_gpio(int argc, char **argv)
 {
+    const int64_t rx_us = esp_timer_get_time();
     if (argc < 2) {
         printf("Usage:\n");
         printf("  gpio list\n");
         printf("  gpio get <pin>\n");
         printf("  gpio set <pin> <0|1>\n");
+        printf("  gpio mset <pin>=<0|1> [<pin>=<0|1> ...]\n");
+        printf("  gpio deb <pin> [<window_us> [<count>]]\n");
         return 0;
     }
 
     if (strcmp(argv[1], "list") == 0) {
         size_t count = 0;
         const uwl_io_entry_t *entries = uwl_io_state_entries(&count);
+        uwl_io_snapshot_t snap;
+        uwl_io_state_snapshot(&snap);
         for (size_t i = 0; i < count; i++) {
-            printf("GPIO%d dir=%s value=%u\n",
+            printf("GPIO%d dir=%s value=%u%s\n",
                    entries[i].pin,
                    entries[i].dir == UWL_IO_DIR_OUTPUT ? "out" : "in",
-                   (unsigned)entries[i].value);
+                   (unsigned)((snap.level_mask >> entries[i].pin) & 1U),
+                   ((snap.poll_mask >> entries[i].pin) & 1U) ? " (polling: irq storm)" : "");
         }
         return 0;
     }
@@ -65,7 +76,70 @@ static int uwl_cmd_gpio(int argc, char **argv)
             printf("ERR %s\n", esp_err_to_name(err));
             return 1;
         }
+        uwl_lat_record_since(UWL_IO_SOURCE_USB, UWL_LAT_GPIO, rx_us);
         printf("OK\n");
+        uwl_lat_record_since(UWL_IO_SOURCE_USB, UWL_LAT_ACK, rx_us);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "mset") == 0) {
+        if (argc < 3) {
+            printf("Usage: gpio mset <pin>=<0|1> [<pin>=<0|1> ...]\n");
+            return 1;
+        }
+        uint32_t mask = 0;
+        uint32_t values = 0;
+        for (int i = 2; i < argc; i++) {
+            int pin = -1;
+            int value = 0;
+            if (sscanf(argv[i], "%d=%d", &pin, &value) != 2 || pin < 0 || pin > 31) {
+                printf("ERR bad pin spec: %s\n", argv[i]);
+                return 1;
+            }
+            mask |= 1UL << pin;
+            if (value) values |= 1UL << pin;
+        }
+        const esp_err_t err = uwl_io_state_set_mask(mask, values, UWL_IO_SOURCE_USB);
+        if (err != ESP_OK) {
+            printf("ERR %s\n", esp_err_to_name(err));
+            return 1;
+        }
+        uwl_lat_record_since(UWL_IO_SOURCE_USB, UWL_LAT_GPIO, rx_us);
+        printf("OK mask=0x%08" PRIx32 " values=0x%08" PRIx32 "\n", mask, values);
+        uwl_lat_record_since(UWL_IO_SOURCE_USB, UWL_LAT_ACK, rx_us);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "deb") == 0) {
+        if (argc < 3) {
+            printf("Usage: gpio deb <pin> [<window_us> [<count>]]\n");
+            return 1;
+        }
+        const int pin = atoi(argv[2]);
+        if (argc >= 4) {
+            const long window_us = strtol(argv[3], NULL, 0);
+            const int count = argc >= 5 ? atoi(argv[4]) : 0;
+            if (window_us < 0 || count < 0 || count > 255) {
+                printf("ERR bad window/count\n");
+                return 1;
+            }
+            const esp_err_t err = uwl_io_state_set_debounce(pin, (uint32_t)window_us, (uint8_t)count);
+            if (err != ESP_OK) {
+                printf("ERR %s\n", esp_err_to_name(err));
+                return 1;
+            }
+        }
+        uwl_gpio_debounce_info_t info;
+        esp_err_t err = uwl_io_state_get_debounce(pin, NULL, NULL);
+        if (err == ESP_OK) err = uwl_gpio_get_debounce(pin, &info);
+        if (err != ESP_OK) {
+            printf("ERR %s\n", esp_err_to_name(err));
+            return 1;
+        }
+        printf("GPIO%d debounce window=%" PRIu32 "us count=%u raw_edges=%" PRIu32 " reported=%" PRIu32
+               " mode=%s storms=%" PRIu32 "\n",
+               pin, info.window_us, (unsigned)info.stable_count, info.raw_edges, info.reported,
+               info.polling ? "poll" : "irq", info.storms);
         return 0;
     }
 
@@ -85,7 +159,40 @@ static int uwl_cmd_ws(int argc, char **argv)
 {
     (void)argc;
     (void)argv;
-    printf("ws clients=%u\n", (unsigned)uwl_ws_get_client_count());
+    uwl_ws_keepalive_stats_t ka;
+    uwl_ws_get_keepalive_stats(&ka);
+    printf("ws clients=%u pings=%" PRIu32 " pongs=%" PRIu32 " reaped=%" PRIu32 "\n",
+           (unsigned)uwl_ws_get_client_count(), ka.pings, ka.pongs, ka.reaped);
+
+    uwl_ws_session_stats_t ss[UWL_HTTP_MAX_OPEN_SOCKETS];
+    const size_t n = uwl_ws_get_session_stats(ss, sizeof(ss) / sizeof(ss[0]));
+    for (size_t i = 0; i < n; i++) {
+        printf("  fd=%d %s sub=0x%08" PRIx32 " rx=%" PRIu32 " tx=%" PRIu32 " tx_bytes=%" PRIu32
+               " tx_errors=%" PRIu32 " idle_ms=%" PRIu32 " rtt_us=%" PRIu32 " rate_limited=%" PRIu32 "\n",
+               ss[i].fd, ss[i].bin ? "bin" : "json", ss[i].sub, ss[i].rx_frames, ss[i].tx_frames, ss[i].tx_bytes,
+               ss[i].tx_errors, ss[i].idle_ms, ss[i].rtt_us, ss[i].rate_limited);
+    }
+    return 0;
+}
+
+static int uwl_cmd_lat(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        uwl_lat_reset();
+        printf("OK\n");
+        return 0;
+    }
+    static const uwl_io_source_t chans[] = { UWL_IO_SOURCE_WIFI, UWL_IO_SOURCE_BLE, UWL_IO_SOURCE_USB,
+                                              UWL_IO_SOURCE_HTTP };
+    for (size_t i = 0; i < sizeof(chans) / sizeof(chans[0]); i++) {
+        for (int k = 0; k < UWL_LAT_KIND_COUNT; k++) {
+            uwl_lat_summary_t sum;
+            uwl_lat_get(chans[i], (uwl_lat_kind_t)k, &sum);
+            printf("%s %s n=%" PRIu32 " p50_us=%" PRIu32 " p99_us=%" PRIu32 " max_us=%" PRIu32 "\n",
+                   uwl_io_source_name(chans[i]), uwl_lat_kind_name((uwl_lat_kind_t)k), sum.count, sum.p50_us,
+                   sum.p99_us, sum.max_us);
+        }
+    }
     return 0;
 }
 
@@ -109,6 +216,39 @@ static int uwl_cmd_status(int argc, char **argv)
     printf("  ble connected=%u notify=%u\n",
            (unsigned)(uwl_ble_is_connected() ? 1 : 0),
            (unsigned)(uwl_ble_is_state_notify_enabled() ? 1 : 0));
+
+    uwl_io_dispatch_stats_t ds;
+    uwl_io_state_get_dispatch_stats(&ds);
+    printf("  io batches=%" PRIu32 " events=%" PRIu32 " max_batch=%" PRIu32 "\n",
+           ds.batches, ds.events, ds.max_batch);
+    printf("  io batch_hist 1:%" PRIu32 " 2-3:%" PRIu32 " 4-7:%" PRIu32 " 8-15:%" PRIu32 " 16+:%" PRIu32 "\n",
+           ds.size_hist[0], ds.size_hist[1], ds.size_hist[2], ds.size_hist[3], ds.size_hist[4]);
+    printf("  io queue hwm=%" PRIu32 "/%" PRIu32 "\n", ds.queue_hwm, ds.queue_len);
+
+    uwl_io_drop_stats_t drops;
+    uwl_io_state_get_drop_stats(&drops);
+    printf("  io drops");
+    for (size_t i = 0; i < UWL_IO_SOURCE_COUNT; i++) {
+        printf(" %s=%" PRIu32, uwl_io_source_name((uwl_io_source_t)i), drops.dropped[i]);
+    }
+    printf(" resyncs=%" PRIu32 " resync_pending=%u\n", drops.resyncs, (unsigned)(drops.resync_pending ? 1 : 0));
+
+    uwl_io_rate_stats_t rate;
+    uwl_io_state_get_rate_stats(&rate);
+    printf("  rate_limited");
+    for (size_t i = 0; i < UWL_IO_SOURCE_COUNT; i++) {
+        printf(" %s=%" PRIu32, uwl_io_source_name((uwl_io_source_t)i), rate.limited[i]);
+    }
+    printf(" ws_frames=%" PRIu32 " ble_writes=%" PRIu32 "\n", uwl_ws_get_rate_limited(), uwl_ble_get_rate_limited());
+
+    uwl_io_listener_stats_t ls[8];
+    const size_t nl = uwl_io_state_get_listener_stats(ls, sizeof(ls) / sizeof(ls[0]));
+    for (size_t i = 0; i < nl; i++) {
+        printf("  listener %s delivered=%" PRIu32 " dropped=%" PRIu32 " coalesced=%" PRIu32
+               " pending=%" PRIu32 " max_pending=%" PRIu32 " max_lag_us=%" PRIu32 "\n",
+               ls[i].name, ls[i].delivered, ls[i].dropped, ls[i].coalesced, ls[i].pending, ls[i].max_pending,
+               ls[i].max_lag_us);
+    }
     return 0;
 }
 
@@ -119,7 +259,7 @@ esp_err_t uwl_usb_console_start(void)
     // Register commands
     esp_console_cmd_t gpio_cmd = {
         .command = "gpio",
-        .help = "GPIO control: list/get/set",
+        .help = "GPIO control: list/get/set/mset/deb",
         .hint = NULL,
         .func = &uwl_cmd_gpio,
         .argtable = NULL,
@@ -137,13 +277,22 @@ esp_err_t uwl_usb_console_start(void)
 
     esp_console_cmd_t ws_cmd = {
         .command = "ws",
-        .help = "WebSocket status: online clients count",
+        .help = "WebSocket status: online clients and per-session counters",
         .hint = NULL,
         .func = &uwl_cmd_ws,
         .argtable = NULL,
     };
     ESP_ERROR_CHECK(esp_console_cmd_register(&ws_cmd));
 
+    esp_console_cmd_t lat_cmd = {
+        .command = "lat",
+        .help = "Command latency per channel (receive->gpio, receive->ack): p50/p99/max; 'lat reset' clears",
+        .hint = NULL,
+        .func = &uwl_cmd_lat,
+        .argtable = NULL,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&lat_cmd));
+
     esp_console_cmd_t ble_cmd = {
         .command = "ble",
         .help = "BLE status: connected/notify",
@@ -155,7 +304,7 @@ esp_err_t uwl_usb_console_start(void)
 
     esp_console_cmd_t status_cmd = {
         .command = "status",
-        .help = "Print system status (wifi/ws/ble)",
+        .help = "Print system status (wifi/ws/ble/io)",
         .hint = NULL,
         .func = &uwl_cmd_status,
         .argtable = NULL,
@@ -179,7 +328,7 @@ esp_err_t uwl_usb_console_start(void)
         return err;
     }
 
-    ESP_LOGI(TAG, "USB console started (type: gpio list/get/set)");
+    ESP_LOGI(TAG, "USB console started (type: gpio list/get/set/mset/deb)");
     return ESP_OK;
 }
 
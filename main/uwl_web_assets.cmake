@@ -0,0 +1,76 @@
+# Bundles and precompresses the WebUI at configure time and generates
+# uwl_web_assets.h with one strong ETag per page.
+#
+# style.css and app.js are inlined into every page, so loading the UI is a
+# single HTTP request: browsers would otherwise open parallel connections for
+# the assets next to the WebSocket, and the LRU purge on the small httpd
+# socket pool could drop the WebSocket to make room.
+#
+# The ETag is a prefix of the SHA-256 of the bundled page, so a firmware with
+# a changed page gets a new tag and browsers refetch it at once, while an
+# unchanged page revalidates with 304 instead of downloading again.
+# gzip runs with mtime=0 so the same source always embeds the same bytes.
+
+set(UWL_WEB_PAGES control.html config.html)
+
+# Sets ${out_var} to the .gz paths to embed; the files themselves are only
+# (re)generated outside IDF's early requirements expansion pass.
+function(uwl_gen_web_assets src_dir out_dir out_var)
+    set(gz_files "")
+    foreach(name ${UWL_WEB_PAGES})
+        list(APPEND gz_files "${out_dir}/${name}.gz")
+    endforeach()
+    set(${out_var} ${gz_files} PARENT_SCOPE)
+    if(CMAKE_BUILD_EARLY_EXPANSION)
+        return()
+    endif()
+
+    idf_build_get_property(python PYTHON)
+    file(MAKE_DIRECTORY "${out_dir}")
+
+    # Editing any source must re-run this, like sdkconfig does for the pin table
+    foreach(name ${UWL_WEB_PAGES} style.css app.js)
+        set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS "${src_dir}/${name}")
+    endforeach()
+    file(READ "${src_dir}/style.css" css)
+    file(READ "${src_dir}/app.js" js)
+
+    set(content "// Generated by main/uwl_web_assets.cmake from main/web. Do not edit.\n")
+    string(APPEND content "#pragma once\n\n")
+    foreach(name ${UWL_WEB_PAGES})
+        set(page "${out_dir}/${name}")
+        set(gz "${page}.gz")
+
+        file(READ "${src_dir}/${name}" html)
+        set(css_tag "<link rel=\"stylesheet\" href=\"/style.css\" />")
+        set(js_tag "<script src=\"/app.js\"></script>")
+        string(FIND "${html}" "${css_tag}" css_at)
+        string(FIND "${html}" "${js_tag}" js_at)
+        if(css_at EQUAL -1 OR js_at EQUAL -1)
+            message(FATAL_ERROR "${name}: expected '${css_tag}' and '${js_tag}' to inline")
+        endif()
+        string(REPLACE "${css_tag}" "<style>\n${css}</style>" html "${html}")
+        string(REPLACE "${js_tag}" "<script>\n${js}</script>" html "${html}")
+        file(WRITE "${page}" "${html}")
+
+        execute_process(
+            COMMAND ${python} -c
+                "import gzip,sys; d=open(sys.argv[1],'rb').read(); open(sys.argv[2],'wb').write(gzip.compress(d,9,mtime=0))"
+                "${page}" "${gz}.tmp"
+            RESULT_VARIABLE rc)
+        if(NOT rc EQUAL 0)
+            message(FATAL_ERROR "gzip of ${page} failed (${rc})")
+        endif()
+        configure_file("${gz}.tmp" "${gz}" COPYONLY)
+
+        file(SHA256 "${page}" hash)
+        string(SUBSTRING "${hash}" 0 16 tag)
+        string(MAKE_C_IDENTIFIER "${name}" id)
+        string(TOUPPER "${id}" id)
+        string(APPEND content "#define UWL_WEB_ETAG_${id} \"\\\"${tag}\\\"\"\n")
+    endforeach()
+
+    set(out_file "${out_dir}/uwl_web_assets.h")
+    file(WRITE "${out_file}.tmp" "${content}")
+    configure_file("${out_file}.tmp" "${out_file}" COPYONLY)
+endfunction()
@@ -8,6 +8,8 @@
 #include "esp_wifi.h"
 #include "sdkconfig.h"
 
+#include "uwl_status.h"
+
 static const char *TAG = "uwl_wifi_ap";
 static volatile int s_sta_count = 0;
 
@@ -37,10 +39,12 @@ static void uwl_wifi_event_handler(void *arg, esp_event_base_t event_base, int32
         case WIFI_EVENT_AP_STACONNECTED:
             s_sta_count++;
             ESP_LOGI(TAG, "Station connected");
+            uwl_status_changed();
             break;
         case WIFI_EVENT_AP_STADISCONNECTED:
             if (s_sta_count > 0) s_sta_count--;
             ESP_LOGI(TAG, "Station disconnected");
+            uwl_status_changed();
             break;
         default:
             break;
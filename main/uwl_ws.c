@@ -1,340 +1,990 @@
 #include "uwl_ws.h"
 
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "cJSON.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
 
-#include "uwl_ble_gatt.h"
+#include "uwl_http.h"
 #include "uwl_io_state.h"
-#include "uwl_wifi_softap.h"
+#include "uwl_lat.h"
+#include "uwl_proto.h"
+#include "uwl_rate.h"
+#include "uwl_status.h"
 
 static const char *TAG = "uwl_ws";
 
+#ifndef CONFIG_UWL_IO_HISTORY_LEN
+#define CONFIG_UWL_IO_HISTORY_LEN 64
+#endif
+// Commands per {"t":"b"} frame, and the room their aggregated resp needs:
+// resp envelope with "r":[], "n", "failed" and "us" (103 B at worst), plus one
+// r[] entry per command. The longest entry, a set_mask with a 64-bit "i", is
+// 75 B, so it fits in UWL_PROTO_ENTRY_MAX_LEN. The reply can then never
+// overflow after the commands have run.
+#define UWL_WS_BATCH_MAX 32
+#define UWL_WS_BATCH_RESP_LEN (128 + UWL_PROTO_ENTRY_MAX_LEN * UWL_WS_BATCH_MAX)
+#define UWL_WS_REQ_BUF_LEN \
+    (UWL_PROTO_STATE_BUF_LEN > UWL_WS_BATCH_RESP_LEN ? UWL_PROTO_STATE_BUF_LEN : UWL_WS_BATCH_RESP_LEN)
+
+#ifndef CONFIG_UWL_WS_PING_INTERVAL_S
+#define CONFIG_UWL_WS_PING_INTERVAL_S 15
+#endif
+#ifndef CONFIG_UWL_WS_IDLE_TIMEOUT_S
+#define CONFIG_UWL_WS_IDLE_TIMEOUT_S 40
+#endif
+// Status frames go out on change; this only re-sends an unchanged one
+#define UWL_WS_STATUS_HEARTBEAT_MS 30000
+#ifndef CONFIG_UWL_WS_MAX_FRAME_LEN
+#define CONFIG_UWL_WS_MAX_FRAME_LEN 2048
+#endif
+#ifndef CONFIG_UWL_RATE_WS_CLIENT_PER_S
+#define CONFIG_UWL_RATE_WS_CLIENT_PER_S 50
+#endif
+#ifndef CONFIG_UWL_RATE_WS_CLIENT_BURST
+#define CONFIG_UWL_RATE_WS_CLIENT_BURST 20
+#endif
+// Keepalive sweep period; ping and idle deadlines are honoured to within this
+#define UWL_WS_SWEEP_S (CONFIG_UWL_WS_PING_INTERVAL_S < 5 ? CONFIG_UWL_WS_PING_INTERVAL_S : 5)
+
+// Per-session state, attached to the httpd session as its ctx at handshake
+// and released by httpd's free_ctx callback when the socket closes (peer
+// close, recv error or LRU purge). Slots are only claimed and released on
+// the httpd task; other tasks read them without a lock and use gen to spot
+// a slot that was released or reused under them. Sending holds tx_lock from
+// the gen check to the end of the frame, and release takes it before bumping
+// gen. A session's fd therefore cannot be closed, accepted again and written
+// to in between. Holding the lock also keeps two tasks' frames from
+// interleaving on one socket.
+typedef struct {
+    uint32_t gen;  // odd while in use; bumped on claim and on release
+    SemaphoreHandle_t tx_lock;
+    int fd;
+    bool bin;      // negotiated the uwl.bin subprotocol: pushes go out as binary records
+    uint32_t sub;  // pins this client wants pushes for ({"t":"sub"}), all by default
+    int64_t opened_us;
+    uint32_t rx_frames;
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    uint32_t tx_errors;
+    // keepalive, httpd task only
+    int64_t last_rx_us;
+    int64_t ping_us;  // last keepalive ping sent, 0 if none
+    bool pong_due;    // that ping is still unanswered
+    bool closing;     // reaped, waiting for httpd to close the socket
+    uint32_t rtt_us;
+    // ingress budget, httpd task only
+    uwl_rate_bucket_t rx_rate;
+    uint32_t rate_limited;
+} uwl_ws_sess_t;
+
+// Consistent copy of a session's routing fields, taken by the sending task
+typedef struct {
+    uwl_ws_sess_t *sess;
+    uint32_t gen;
+    int fd;
+    bool bin;
+    uint32_t sub;
+} uwl_ws_peer_t;
+
 static httpd_handle_t s_server = NULL;
-static SemaphoreHandle_t s_clients_lock = NULL;
-static int s_clients[8];
-static size_t s_client_count = 0;
+static uwl_ws_sess_t s_sess[UWL_HTTP_MAX_OPEN_SOCKETS];
+static uint32_t s_sess_count = 0;
 static bool s_status_task_started = false;
+static esp_timer_handle_t s_keepalive_timer = NULL;
+static uwl_ws_keepalive_stats_t s_keepalive;
+static uint32_t s_rate_limited = 0;
+static uwl_ws_tx_stats_t s_tx_totals;
 
 size_t uwl_ws_get_client_count(void)
 {
-    if (!s_clients_lock) return 0;
-    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
-    const size_t n = s_client_count;
-    xSemaphoreGive(s_clients_lock);
-    return n;
+    return __atomic_load_n(&s_sess_count, __ATOMIC_RELAXED);
 }
 
-static void uwl_ws_client_add(int fd)
+static void uwl_ws_sess_release(void *ctx)
 {
-    if (!s_clients_lock) return;
-    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
-    for (size_t i = 0; i < s_client_count; i++) {
-        if (s_clients[i] == fd) {
-            xSemaphoreGive(s_clients_lock);
-            return;
-        }
+    uwl_ws_sess_t *sess = (uwl_ws_sess_t *)ctx;
+    if (!sess) return;
+    // httpd has closed the fd but accepts nothing until this returns: wait
+    // out a send in flight, then no other task passes the gen check
+    xSemaphoreTake(sess->tx_lock, portMAX_DELAY);
+    __atomic_store_n(&sess->gen, sess->gen + 1U, __ATOMIC_RELEASE);
+    xSemaphoreGive(sess->tx_lock);
+    __atomic_fetch_sub(&s_sess_count, 1U, __ATOMIC_RELAXED);
+    uwl_status_changed();
+}
+
+// httpd task only (handshake). The table has a slot per server socket, so it
+// only runs out if a slot leaked.
+static uwl_ws_sess_t *uwl_ws_sess_claim(int fd, bool bin)
+{
+    for (size_t i = 0; i < UWL_HTTP_MAX_OPEN_SOCKETS; i++) {
+        uwl_ws_sess_t *sess = &s_sess[i];
+        const uint32_t gen = sess->gen;
+        if (gen & 1U) continue;
+        sess->fd = fd;
+        sess->bin = bin;
+        sess->sub = UINT32_MAX;
+        sess->opened_us = esp_timer_get_time();
+        sess->rx_frames = 0;
+        sess->tx_frames = 0;
+        sess->tx_bytes = 0;
+        sess->tx_errors = 0;
+        sess->last_rx_us = sess->opened_us;
+        sess->ping_us = 0;
+        sess->pong_due = false;
+        sess->closing = false;
+        sess->rtt_us = 0;
+        uwl_rate_init(&sess->rx_rate, CONFIG_UWL_RATE_WS_CLIENT_PER_S, CONFIG_UWL_RATE_WS_CLIENT_BURST,
+                      sess->opened_us);
+        sess->rate_limited = 0;
+        __atomic_store_n(&sess->gen, gen + 1U, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&s_sess_count, 1U, __ATOMIC_RELAXED);
+        uwl_status_changed();
+        return sess;
     }
-    if (s_client_count < (sizeof(s_clients) / sizeof(s_clients[0]))) {
-        s_clients[s_client_count++] = fd;
+    return NULL;
+}
+
+static bool uwl_ws_sess_read(uwl_ws_sess_t *sess, uwl_ws_peer_t *out)
+{
+    const uint32_t gen = __atomic_load_n(&sess->gen, __ATOMIC_ACQUIRE);
+    if (!(gen & 1U)) return false;
+    *out = (uwl_ws_peer_t){ .sess = sess, .gen = gen, .fd = sess->fd, .bin = sess->bin, .sub = sess->sub };
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&sess->gen, __ATOMIC_RELAXED) == gen;
+}
+
+// only != NULL: just that session. Returns the number copied to out.
+static size_t uwl_ws_peers_get(uwl_ws_sess_t *only, uwl_ws_peer_t *out, size_t cap)
+{
+    size_t n = 0;
+    if (only) return (cap > 0 && uwl_ws_sess_read(only, &out[0])) ? 1 : 0;
+    for (size_t i = 0; i < UWL_HTTP_MAX_OPEN_SOCKETS && n < cap; i++) {
+        if (uwl_ws_sess_read(&s_sess[i], &out[n])) n++;
     }
-    xSemaphoreGive(s_clients_lock);
+    return n;
 }
 
-static void uwl_ws_client_remove(int fd)
+size_t uwl_ws_get_session_stats(uwl_ws_session_stats_t *out, size_t cap)
 {
-    if (!s_clients_lock) return;
-    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
-    for (size_t i = 0; i < s_client_count; i++) {
-        if (s_clients[i] == fd) {
-            s_clients[i] = s_clients[s_client_count - 1];
-            s_client_count--;
-            break;
-        }
+    size_t n = 0;
+    if (!out) return 0;
+    for (size_t i = 0; i < UWL_HTTP_MAX_OPEN_SOCKETS && n < cap; i++) {
+        uwl_ws_sess_t *sess = &s_sess[i];
+        uwl_ws_peer_t p;
+        if (!uwl_ws_sess_read(sess, &p)) continue;
+        out[n] = (uwl_ws_session_stats_t){
+            .fd = p.fd,
+            .bin = p.bin,
+            .sub = p.sub,
+            .opened_us = sess->opened_us,
+            .rx_frames = __atomic_load_n(&sess->rx_frames, __ATOMIC_RELAXED),
+            .tx_frames = __atomic_load_n(&sess->tx_frames, __ATOMIC_RELAXED),
+            .tx_bytes = __atomic_load_n(&sess->tx_bytes, __ATOMIC_RELAXED),
+            .tx_errors = __atomic_load_n(&sess->tx_errors, __ATOMIC_RELAXED),
+            .idle_ms = (uint32_t)((esp_timer_get_time() - sess->last_rx_us) / 1000),
+            .rtt_us = sess->rtt_us,
+            .rate_limited = __atomic_load_n(&sess->rate_limited, __ATOMIC_RELAXED),
+        };
+        // Released while copying: drop the entry rather than mix two sessions
+        if (__atomic_load_n(&sess->gen, __ATOMIC_ACQUIRE) == p.gen) n++;
     }
-    xSemaphoreGive(s_clients_lock);
+    return n;
+}
+
+void uwl_ws_get_keepalive_stats(uwl_ws_keepalive_stats_t *out)
+{
+    if (!out) return;
+    out->pings = __atomic_load_n(&s_keepalive.pings, __ATOMIC_RELAXED);
+    out->pongs = __atomic_load_n(&s_keepalive.pongs, __ATOMIC_RELAXED);
+    out->reaped = __atomic_load_n(&s_keepalive.reaped, __ATOMIC_RELAXED);
+}
+
+void uwl_ws_get_tx_stats(uwl_ws_tx_stats_t *out)
+{
+    if (!out) return;
+    out->frames = __atomic_load_n(&s_tx_totals.frames, __ATOMIC_RELAXED);
+    out->bytes = __atomic_load_n(&s_tx_totals.bytes, __ATOMIC_RELAXED);
+    out->errors = __atomic_load_n(&s_tx_totals.errors, __ATOMIC_RELAXED);
+}
+
+uint32_t uwl_ws_get_rate_limited(void)
+{
+    return __atomic_load_n(&s_rate_limited, __ATOMIC_RELAXED);
 }
 
-static esp_err_t uwl_ws_send_text_to_fd(int fd, const char *text)
+static esp_err_t uwl_ws_send_frame_to_fd(int fd, httpd_ws_type_t type, const void *data, size_t len)
 {
-    if (!s_server || !text) return ESP_ERR_INVALID_STATE;
+    if (!s_server || !data) return ESP_ERR_INVALID_STATE;
     httpd_ws_frame_t frame = {
         .final = true,
         .fragmented = false,
-        .type = HTTPD_WS_TYPE_TEXT,
-        .payload = (uint8_t *)text,
-        .len = strlen(text),
+        .type = type,
+        .payload = (uint8_t *)data,
+        .len = len,
     };
     return httpd_ws_send_frame_async(s_server, fd, &frame);
 }
 
-static void uwl_ws_broadcast_text(const char *text)
+static void uwl_ws_sess_count_tx(uwl_ws_sess_t *sess, size_t len, esp_err_t err)
+{
+    if (err == ESP_OK) {
+        __atomic_fetch_add(&s_tx_totals.frames, 1U, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s_tx_totals.bytes, (uint32_t)len, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&s_tx_totals.errors, 1U, __ATOMIC_RELAXED);
+    }
+    if (!sess) return;
+    if (err == ESP_OK) {
+        __atomic_fetch_add(&sess->tx_frames, 1U, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&sess->tx_bytes, (uint32_t)len, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&sess->tx_errors, 1U, __ATOMIC_RELAXED);
+    }
+}
+
+// Replies from the request handler: the session is the one being served
+static esp_err_t uwl_ws_send_frame_req(httpd_req_t *req, httpd_ws_type_t type, const void *data, size_t len)
 {
-    if (!text || !s_clients_lock) return;
+    uwl_ws_sess_t *sess = (uwl_ws_sess_t *)req->sess_ctx;
+    if (sess) xSemaphoreTake(sess->tx_lock, portMAX_DELAY);
+    const esp_err_t err = uwl_ws_send_frame_to_fd(httpd_req_to_sockfd(req), type, data, len);
+    if (sess) xSemaphoreGive(sess->tx_lock);
+    uwl_ws_sess_count_tx(sess, len, err);
+    return err;
+}
 
-    int fds[8];
-    size_t n = 0;
-    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
-    n = s_client_count;
-    if (n > 8) n = 8;
-    for (size_t i = 0; i < n; i++) fds[i] = s_clients[i];
-    xSemaphoreGive(s_clients_lock);
+static esp_err_t uwl_ws_send_text_req(httpd_req_t *req, const char *text)
+{
+    if (!text) return ESP_ERR_INVALID_STATE;
+    return uwl_ws_send_frame_req(req, HTTPD_WS_TYPE_TEXT, text, strlen(text));
+}
 
+// httpd task only, like every other write to a claimed session
+static esp_err_t uwl_ws_sess_set_sub(httpd_req_t *req, uint32_t sub)
+{
+    uwl_ws_sess_t *sess = (uwl_ws_sess_t *)req->sess_ctx;
+    if (!sess) return ESP_ERR_INVALID_STATE;
+    __atomic_store_n(&sess->sub, sub, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+// Pushes from other tasks: skip a peer whose session closed since the
+// snapshot, so a reused fd never gets another client's data. The check and
+// the send happen under tx_lock, which release also takes.
+static void uwl_ws_send_peer(const uwl_ws_peer_t *p, httpd_ws_type_t type, const void *data, size_t len)
+{
+    xSemaphoreTake(p->sess->tx_lock, portMAX_DELAY);
+    if (__atomic_load_n(&p->sess->gen, __ATOMIC_ACQUIRE) != p->gen) {
+        xSemaphoreGive(p->sess->tx_lock);
+        return;
+    }
+    const esp_err_t err = uwl_ws_send_frame_to_fd(p->fd, type, data, len);
+    xSemaphoreGive(p->sess->tx_lock);
+    uwl_ws_sess_count_tx(p->sess, len, err);
+    // INVALID_ARG/STATE: session already gone, its free_ctx releases the slot.
+    // Anything else is a broken socket: have httpd close it now.
+    if (err != ESP_OK && err != ESP_ERR_INVALID_ARG && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(TAG, "ws send failed fd=%d: %s", p->fd, esp_err_to_name(err));
+        (void)httpd_sess_trigger_close(s_server, p->fd);
+    }
+}
+
+// Sends to the peers in pl[] that share like's protocol and subscription
+static void uwl_ws_fanout(const uwl_ws_peer_t *pl, size_t n, const uwl_ws_peer_t *like, const void *data,
+                          size_t len)
+{
     for (size_t i = 0; i < n; i++) {
-        const esp_err_t err = uwl_ws_send_text_to_fd(fds[i], text);
-        if (err != ESP_OK) {
-            // Common when client disconnects or session is purged: avoid log spam.
-            if (err != ESP_ERR_INVALID_ARG && err != ESP_ERR_INVALID_STATE) {
-                ESP_LOGW(TAG, "ws send failed fd=%d: %s", fds[i], esp_err_to_name(err));
-            }
-            uwl_ws_client_remove(fds[i]);
-        }
+        if (pl[i].bin != like->bin || pl[i].sub != like->sub) continue;
+        uwl_ws_send_peer(&pl[i], like->bin ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT, data, len);
     }
 }
 
+// Status and snapshots: JSON text to every peer in pl[], whatever it subscribed to
+static void uwl_ws_fanout_text_all(const uwl_ws_peer_t *pl, size_t n, const char *text)
+{
+    const size_t len = strlen(text);
+    for (size_t i = 0; i < n; i++) uwl_ws_send_peer(&pl[i], HTTPD_WS_TYPE_TEXT, text, len);
+}
+
+static void uwl_ws_broadcast_text(const char *text)
+{
+    if (!text) return;
+    uwl_ws_peer_t pl[UWL_HTTP_MAX_OPEN_SOCKETS];
+    const size_t n = uwl_ws_peers_get(NULL, pl, UWL_HTTP_MAX_OPEN_SOCKETS);
+    uwl_ws_fanout_text_all(pl, n, text);
+}
+
 static void uwl_ws_status_task(void *arg)
 {
     (void)arg;
+    (void)uwl_status_subscribe(NULL);
+    uwl_status_t last = { 0 };
+
+    // Pushed when something visible changed, plus a slow heartbeat
     while (true) {
-        const size_t clients = uwl_ws_get_client_count();
-        if (clients > 0) {
-            const int sta = uwl_wifi_softap_get_sta_count();
-            const bool ble_conn = uwl_ble_is_connected();
-            const bool ble_notify = uwl_ble_is_state_notify_enabled();
-
-            char buf[192];
-            const int n = snprintf(buf, sizeof(buf),
-                                   "{\"type\":\"status\",\"sta_count\":%d,\"ws_clients\":%u,\"ble_connected\":%s,\"ble_notify\":%s}",
-                                   sta,
-                                   (unsigned)clients,
-                                   ble_conn ? "true" : "false",
-                                   ble_notify ? "true" : "false");
-            if (n > 0 && (size_t)n < sizeof(buf)) {
-                uwl_ws_broadcast_text(buf);
-            }
-        }
-        vTaskDelay(pdMS_TO_TICKS(5000));
+        const bool changed = uwl_status_wait(pdMS_TO_TICKS(UWL_WS_STATUS_HEARTBEAT_MS));
+        uwl_status_t st;
+        uwl_status_get(&st);
+        if (st.ws_clients == 0) continue;
+        if (changed && uwl_status_equal(&st, &last)) continue;
+        last = st;
+
+        char buf[UWL_PROTO_SMALL_BUF_LEN];
+        if (uwl_proto_encode_status(buf, sizeof(buf), &st) > 0) uwl_ws_broadcast_text(buf);
     }
 }
 
-static char *uwl_build_state_json(void)
+// Encode buffers, one per sending task: the io listener worker owns
+// s_evt_buf, the httpd task (handshake, commands) owns s_req_buf.
+// httpd_ws_send_frame_async writes the frame before returning.
+static char s_evt_buf[UWL_PROTO_STATE_BUF_LEN];
+static char s_req_buf[UWL_WS_REQ_BUF_LEN];
+static uwl_io_event_t s_catchup_evts[CONFIG_UWL_IO_HISTORY_LEN];
+// Inbound text/binary payload (+ NUL). httpd reads and handles one frame at
+// a time on its task, so one buffer serves every session.
+static char s_rx_buf[CONFIG_UWL_WS_MAX_FRAME_LEN + 1];
+// When the frame being handled arrived (header read), for latency accounting
+static int64_t s_rx_us = 0;
+
+// resp with "us" (receive -> reply built); httpd task only
+static int uwl_ws_resp_end(uwl_proto_writer_t *w, bool with_data)
 {
-    size_t count = 0;
-    const uwl_io_entry_t *entries = uwl_io_state_entries(&count);
+    return uwl_proto_resp_end_us(w, with_data, esp_timer_get_time() - s_rx_us);
+}
 
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "state");
-    cJSON *arr = cJSON_AddArrayToObject(root, "gpios");
+static void uwl_ws_note_gpio_write(void)
+{
+    uwl_lat_record_since(UWL_IO_SOURCE_WIFI, UWL_LAT_GPIO, s_rx_us);
+}
 
+static void uwl_ws_send_err(httpd_req_t *req, int id, const char *code, const char *msg)
+{
+    char buf[UWL_PROTO_SMALL_BUF_LEN];
+    if (uwl_proto_encode_err(buf, sizeof(buf), id, code, msg) > 0) (void)uwl_ws_send_text_req(req, buf);
+}
+
+static void uwl_ws_send_resp_ok(httpd_req_t *req, int id)
+{
+    char buf[UWL_PROTO_SMALL_BUF_LEN];
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, sizeof(buf));
+    uwl_proto_resp_begin(&w, id, false);
+    if (uwl_ws_resp_end(&w, false) > 0) (void)uwl_ws_send_text_req(req, buf);
+}
+
+static void uwl_ws_send_events_text(const uwl_ws_peer_t *pl, size_t npl, const uwl_ws_peer_t *like,
+                                    const uwl_io_event_t *evts, size_t count, char *buf, size_t cap)
+{
     for (size_t i = 0; i < count; i++) {
-        cJSON *o = cJSON_CreateObject();
-        cJSON_AddNumberToObject(o, "pin", entries[i].pin);
-        cJSON_AddStringToObject(o, "dir", entries[i].dir == UWL_IO_DIR_OUTPUT ? "out" : "in");
-        cJSON_AddNumberToObject(o, "value", entries[i].value ? 1 : 0);
-        cJSON_AddItemToArray(arr, o);
+        if (evts[i].reason != UWL_IO_REASON_MODE || !((like->sub >> evts[i].pin) & 1U)) continue;
+        const int n = uwl_proto_encode_mode(buf, cap, &evts[i]);
+        if (n > 0) uwl_ws_fanout(pl, npl, like, buf, (size_t)n);
     }
 
-    char *s = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    return s;
+    // Mode events carry no mask and add no entries; a batch larger than the
+    // buffer goes out as several gpio_changed frames
+    while (count > 0) {
+        size_t used = 0;
+        const int n = uwl_proto_encode_changed(buf, cap, evts, count, like->sub, &used);
+        if (n > 0) uwl_ws_fanout(pl, npl, like, buf, (size_t)n);
+        evts += used;
+        count -= used;
+    }
 }
 
-static char *uwl_build_gpio_changed_json(const uwl_io_event_t *evt)
+static void uwl_ws_send_events_bin(const uwl_ws_peer_t *pl, size_t npl, const uwl_ws_peer_t *like,
+                                   const uwl_io_event_t *evts, size_t count, char *buf, size_t cap)
 {
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "gpio_changed");
-    cJSON_AddNumberToObject(root, "pin", evt->pin);
-    cJSON_AddNumberToObject(root, "value", evt->value ? 1 : 0);
-    cJSON_AddStringToObject(root, "dir", evt->dir == UWL_IO_DIR_OUTPUT ? "out" : "in");
-    cJSON_AddStringToObject(root, "reason", evt->reason == UWL_IO_REASON_INPUT_EDGE ? "edge" :
-                                        evt->reason == UWL_IO_REASON_SET_CMD ? "set" : "boot");
-    char *s = cJSON_PrintUnformatted(root);
-    cJSON_Delete(root);
-    return s;
+    // Records keep queue order, mode switches included
+    while (count > 0) {
+        size_t used = 0;
+        const size_t n = uwl_proto_bin_put_events((uint8_t *)buf, cap, evts, count, like->sub, &used);
+        if (n > 0) uwl_ws_fanout(pl, npl, like, buf, n);
+        evts += used;
+        count -= used;
+    }
 }
 
-static const char *uwl_err_code_from_esp(esp_err_t e)
+// only == NULL: every session. Sessions sharing protocol and subscription
+// form one group, so each distinct view of the batch is encoded once.
+static void uwl_ws_send_events(uwl_ws_sess_t *only, const uwl_io_event_t *evts, size_t count, char *buf,
+                               size_t cap)
 {
-    if (e == ESP_OK) return "OK";
-    if (e == ESP_ERR_NOT_FOUND) return "NOT_FOUND";
-    if (e == ESP_ERR_INVALID_STATE) return "NOT_OUTPUT";
-    if (e == ESP_ERR_INVALID_ARG) return "BAD_ARG";
-    if (e == ESP_ERR_NO_MEM) return "NO_MEM";
-    if (e == ESP_ERR_NOT_SUPPORTED) return "NOT_SUPPORTED";
-    return "FAIL";
+    uwl_ws_peer_t pl[UWL_HTTP_MAX_OPEN_SOCKETS];
+    const size_t npl = uwl_ws_peers_get(only, pl, UWL_HTTP_MAX_OPEN_SOCKETS);
+    if (npl == 0) return;
+
+    // Events were lost somewhere upstream: the current snapshot supersedes the batch
+    uint32_t touched = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (evts[i].reason == UWL_IO_REASON_RESYNC) {
+            if (uwl_proto_encode_state(buf, cap) > 0) uwl_ws_fanout_text_all(pl, npl, buf);
+            return;
+        }
+        touched |= evts[i].reason == UWL_IO_REASON_MODE ? (1UL << evts[i].pin) : evts[i].mask;
+    }
+
+    bool done[UWL_HTTP_MAX_OPEN_SOCKETS] = { false };
+    for (size_t g = 0; g < npl; g++) {
+        if (done[g]) continue;
+        for (size_t k = g; k < npl; k++) {
+            if (pl[k].bin == pl[g].bin && pl[k].sub == pl[g].sub) done[k] = true;
+        }
+        // Nothing this group subscribed to: no encode, no send
+        if ((touched & pl[g].sub) == 0) continue;
+        if (pl[g].bin) {
+            uwl_ws_send_events_bin(pl, npl, &pl[g], evts, count, buf, cap);
+        } else {
+            uwl_ws_send_events_text(pl, npl, &pl[g], evts, count, buf, cap);
+        }
+    }
 }
 
-static const char *uwl_json_get_str2(const cJSON *root, const char *k1, const char *k2)
+static void uwl_ws_on_io_batch(const uwl_io_event_t *evts, size_t count, void *ctx)
 {
-    const cJSON *a = cJSON_GetObjectItemCaseSensitive(root, k1);
-    if (cJSON_IsString(a) && a->valuestring) return a->valuestring;
-    const cJSON *b = cJSON_GetObjectItemCaseSensitive(root, k2);
-    if (cJSON_IsString(b) && b->valuestring) return b->valuestring;
-    return NULL;
+    (void)ctx;
+    if (!evts || count == 0) return;
+    if (uwl_ws_get_client_count() == 0) return;
+    uwl_ws_send_events(NULL, evts, count, s_evt_buf, sizeof(s_evt_buf));
 }
 
-static int uwl_json_get_i32_2(const cJSON *root, const char *k1, const char *k2, int defv)
+// Reconnect catch-up: send only the events after since_seq, or the full
+// state when the history no longer reaches back that far.
+// Returns the number of replayed events, -1 if a snapshot was sent instead.
+// httpd task only (shares s_req_buf and s_catchup_evts).
+static int uwl_ws_send_catchup(httpd_req_t *req, uint32_t boot_id, uint32_t since_seq)
 {
-    const cJSON *a = cJSON_GetObjectItemCaseSensitive(root, k1);
-    if (cJSON_IsNumber(a)) return a->valueint;
-    const cJSON *b = cJSON_GetObjectItemCaseSensitive(root, k2);
-    if (cJSON_IsNumber(b)) return b->valueint;
-    return defv;
+    size_t n = 0;
+    const esp_err_t err = uwl_io_state_history_since(boot_id, since_seq, s_catchup_evts,
+                                                     CONFIG_UWL_IO_HISTORY_LEN, &n);
+    uwl_ws_sess_t *sess = (uwl_ws_sess_t *)req->sess_ctx;
+    if (err == ESP_OK && sess) {
+        if (n > 0) uwl_ws_send_events(sess, s_catchup_evts, n, s_req_buf, sizeof(s_req_buf));
+        return (int)n;
+    }
+
+    if (uwl_proto_encode_state(s_req_buf, sizeof(s_req_buf)) > 0) (void)uwl_ws_send_text_req(req, s_req_buf);
+    return -1;
 }
 
-static void uwl_ws_send_err_to_fd(int fd, int id, const char *code, const char *msg)
+static bool uwl_type_is(const char *type, const char *a, const char *b, const char *c)
 {
-    cJSON *o = cJSON_CreateObject();
-    if (!o) return;
-    cJSON_AddStringToObject(o, "type", "err");
-    if (id >= 0) cJSON_AddNumberToObject(o, "id", id);
-    if (code) cJSON_AddStringToObject(o, "code", code);
-    if (msg) cJSON_AddStringToObject(o, "msg", msg);
-    char *s = cJSON_PrintUnformatted(o);
-    cJSON_Delete(o);
-    if (s) {
-        (void)uwl_ws_send_text_to_fd(fd, s);
-        cJSON_free(s);
-    }
+    return strcmp(type, a) == 0 || (b && strcmp(type, b) == 0) || (c && strcmp(type, c) == 0);
 }
 
-static void uwl_ws_send_resp_ok_to_fd(int fd, int id, cJSON *data_opt)
+// Runs one set / set_mask / debounce / get and appends its resp data members
+// to w (nothing on failure). ESP_ERR_NOT_SUPPORTED: not one of those.
+static esp_err_t uwl_ws_exec_cmd(const uwl_proto_cmd_t *cmd, uwl_proto_writer_t *w, const char **what)
 {
-    cJSON *o = cJSON_CreateObject();
-    if (!o) {
-        if (data_opt) cJSON_Delete(data_opt);
-        return;
+    const char *type = cmd->type;
+    const int pin = uwl_proto_get_int(cmd, UWL_PROTO_F_PIN, -1);
+    const int value = uwl_proto_get_int(cmd, UWL_PROTO_F_VALUE, 0);
+    esp_err_t err = ESP_OK;
+
+    // set (v1/v2)
+    if (uwl_type_is(type, "gpio_set", "s", "set")) {
+        *what = "gpio_set failed";
+        if (pin < 0) return ESP_ERR_INVALID_ARG;
+        err = uwl_io_state_set(pin, (uint8_t)(value ? 1 : 0), UWL_IO_SOURCE_WIFI);
+        if (err != ESP_OK) return err;
+        uwl_ws_note_gpio_write();
+        uwl_proto_i64(w, "pin", pin);
+        uwl_proto_u32(w, "value", value ? 1 : 0);
+        return ESP_OK;
+    }
+    // batch set: all pins in mask switch on the same edge
+    if (uwl_type_is(type, "gpio_set_mask", "m", NULL)) {
+        *what = "gpio_set_mask failed";
+        const uint32_t mask = uwl_proto_get_u32(cmd, UWL_PROTO_F_MASK, 0);
+        const uint32_t values = uwl_proto_get_u32(cmd, UWL_PROTO_F_VALUE, 0);
+        err = uwl_io_state_set_mask(mask, values, UWL_IO_SOURCE_WIFI);
+        if (err != ESP_OK) return err;
+        uwl_ws_note_gpio_write();
+        uwl_proto_u32(w, "mask", mask);
+        uwl_proto_u32(w, "values", values & mask);
+        return ESP_OK;
+    }
+    // input debounce: with "w" sets the window, without it reads it back
+    if (uwl_type_is(type, "gpio_debounce", "db", NULL)) {
+        *what = "gpio_debounce failed";
+        if (pin < 0) return ESP_ERR_INVALID_ARG;
+        if (uwl_proto_has(cmd, UWL_PROTO_F_WINDOW)) {
+            const int64_t win = uwl_proto_get(cmd, UWL_PROTO_F_WINDOW, 0);
+            const int n = uwl_proto_get_int(cmd, UWL_PROTO_F_COUNT, 0);
+            if (win < 0 || win > UINT32_MAX || n < 0 || n > 255) return ESP_ERR_INVALID_ARG;
+            err = uwl_io_state_set_debounce(pin, (uint32_t)win, (uint8_t)n);
+            if (err != ESP_OK) return err;
+        }
+        uint32_t window_us = 0;
+        uint8_t count = 0;
+        err = uwl_io_state_get_debounce(pin, &window_us, &count);
+        if (err != ESP_OK) return err;
+        uwl_proto_i64(w, "pin", pin);
+        uwl_proto_u32(w, "w", window_us);
+        uwl_proto_u32(w, "n", count);
+        return ESP_OK;
     }
-    cJSON_AddStringToObject(o, "type", "resp");
-    if (id >= 0) cJSON_AddNumberToObject(o, "id", id);
-    cJSON_AddBoolToObject(o, "ok", true);
-    if (data_opt) cJSON_AddItemToObject(o, "data", data_opt);
-    char *s = cJSON_PrintUnformatted(o);
-    cJSON_Delete(o);
-    if (s) {
-        (void)uwl_ws_send_text_to_fd(fd, s);
-        cJSON_free(s);
+    // get (v2 addition for Wi-Fi parity with BLE)
+    if (uwl_type_is(type, "gpio_get", "g", "get")) {
+        *what = "gpio_get failed";
+        if (pin < 0) return ESP_ERR_INVALID_ARG;
+        uint8_t v = 0;
+        err = uwl_io_state_get(pin, &v);
+        if (err != ESP_OK) return err;
+        uwl_proto_i64(w, "pin", pin);
+        uwl_proto_u32(w, "value", v ? 1 : 0);
+        return ESP_OK;
     }
+    *what = "unknown type";
+    return ESP_ERR_NOT_SUPPORTED;
 }
 
-static void uwl_ws_on_io_event(const uwl_io_event_t *evt, void *ctx)
+// Atomic batch: every entry must be a set; they are merged (later entries win
+// per pin) into one uwl_io_state_set_mask call, so all pins switch together.
+static esp_err_t uwl_ws_batch_merge_sets(const uwl_proto_cmd_t *batch, uint32_t *mask_out, uint32_t *values_out)
 {
-    (void)ctx;
-    if (!evt) return;
+    uint32_t mask = 0;
+    uint32_t values = 0;
+    size_t off = 0;
+    const char *elem = NULL;
+    size_t elem_len = 0;
+    esp_err_t rc;
+    while ((rc = uwl_proto_list_next(batch, &off, &elem, &elem_len)) == ESP_OK) {
+        uwl_proto_cmd_t c;
+        if (uwl_proto_parse_cmd(elem, elem_len, &c) != ESP_OK) return ESP_ERR_INVALID_ARG;
+        uint32_t m = 0;
+        uint32_t v = 0;
+        if (uwl_type_is(c.type, "gpio_set", "s", "set")) {
+            const int pin = uwl_proto_get_int(&c, UWL_PROTO_F_PIN, -1);
+            if (pin < 0 || pin > 31) return ESP_ERR_INVALID_ARG;
+            m = 1UL << pin;
+            v = uwl_proto_get_int(&c, UWL_PROTO_F_VALUE, 0) ? m : 0;
+        } else if (uwl_type_is(c.type, "gpio_set_mask", "m", NULL)) {
+            m = uwl_proto_get_u32(&c, UWL_PROTO_F_MASK, 0);
+            v = uwl_proto_get_u32(&c, UWL_PROTO_F_VALUE, 0);
+        } else {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        values = (values & ~m) | (v & m);
+        mask |= m;
+    }
+    if (rc != ESP_ERR_NOT_FOUND) return rc;
+    *mask_out = mask;
+    *values_out = values;
+    return ESP_OK;
+}
 
-    char *msg = uwl_build_gpio_changed_json(evt);
-    if (!msg) return;
-    uwl_ws_broadcast_text(msg);
-    cJSON_free(msg);
+// {"t":"b","c":[{...},...],"a":1,"i":N}: the commands of one frame, answered
+// by one resp. Without "a", each entry runs in order and reports its own
+// result in data.r[]; with "a":1, only sets are accepted and applied at once.
+static void uwl_ws_handle_batch(httpd_req_t *req, const uwl_proto_cmd_t *batch, int id)
+{
+    // Validate the whole list before running anything
+    size_t count = 0;
+    size_t off = 0;
+    const char *elem = NULL;
+    size_t elem_len = 0;
+    esp_err_t rc;
+    while ((rc = uwl_proto_list_next(batch, &off, &elem, &elem_len)) == ESP_OK) count++;
+    if (!batch->list || rc != ESP_ERR_NOT_FOUND || count == 0) {
+        uwl_ws_send_err(req, id, "BAD_ARG", "c must be a non-empty array");
+        return;
+    }
+    if (count > UWL_WS_BATCH_MAX) {
+        uwl_ws_send_err(req, id, "BAD_ARG", "too many commands");
+        return;
+    }
+
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, s_req_buf, sizeof(s_req_buf));
+
+    if (uwl_proto_get(batch, UWL_PROTO_F_ATOMIC, 0)) {
+        uint32_t mask = 0;
+        uint32_t values = 0;
+        esp_err_t err = uwl_ws_batch_merge_sets(batch, &mask, &values);
+        if (err == ESP_OK) err = uwl_io_state_set_mask(mask, values, UWL_IO_SOURCE_WIFI);
+        if (err != ESP_OK) {
+            uwl_ws_send_err(req, id, uwl_proto_err_code(err), "atomic batch failed");
+            return;
+        }
+        uwl_ws_note_gpio_write();
+        uwl_proto_resp_begin(&w, id, true);
+        uwl_proto_u32(&w, "n", (uint32_t)count);
+        uwl_proto_u32(&w, "mask", mask);
+        uwl_proto_u32(&w, "values", values);
+        if (uwl_ws_resp_end(&w, true) > 0) (void)uwl_ws_send_text_req(req, s_req_buf);
+        return;
+    }
+
+    size_t failed = 0;
+    uwl_proto_resp_begin(&w, id, true);
+    uwl_proto_arr_begin(&w, "r");
+    off = 0;
+    while (uwl_proto_list_next(batch, &off, &elem, &elem_len) == ESP_OK) {
+        uwl_proto_cmd_t c;
+        const char *what = NULL;
+        uwl_proto_obj_begin(&w, NULL);
+        esp_err_t err = ESP_ERR_INVALID_ARG;
+        if (uwl_proto_parse_cmd(elem, elem_len, &c) == ESP_OK) {
+            if (uwl_proto_has(&c, UWL_PROTO_F_ID)) uwl_proto_i64(&w, "i", uwl_proto_get(&c, UWL_PROTO_F_ID, 0));
+            if (c.type[0] != '\0') err = uwl_ws_exec_cmd(&c, &w, &what);
+        }
+        uwl_proto_bool(&w, "ok", err == ESP_OK);
+        if (err != ESP_OK) {
+            uwl_proto_str(&w, "code", uwl_proto_err_code(err));
+            failed++;
+        }
+        uwl_proto_obj_end(&w);
+    }
+    uwl_proto_arr_end(&w);
+    uwl_proto_u32(&w, "n", (uint32_t)count);
+    uwl_proto_u32(&w, "failed", (uint32_t)failed);
+    if (uwl_ws_resp_end(&w, true) > 0) {
+        (void)uwl_ws_send_text_req(req, s_req_buf);
+    } else {
+        // The commands already ran; only the reply did not fit
+        uwl_ws_send_err(req, id, "NO_MEM", "batch reply too large");
+    }
 }
 
 static esp_err_t uwl_ws_handle_message(httpd_req_t *req, const char *payload, size_t len)
 {
-    (void)len;
-    cJSON *root = cJSON_Parse(payload);
-    if (!root) return ESP_ERR_INVALID_ARG;
-
-    const int fd = httpd_req_to_sockfd(req);
-    const char *type = uwl_json_get_str2(root, "type", "t");
-    const int id = uwl_json_get_i32_2(root, "id", "i", -1);
-    const int pin = uwl_json_get_i32_2(root, "pin", "p", -1);
-    const int value = uwl_json_get_i32_2(root, "value", "v", 0);
-    if (!type) {
-        uwl_ws_send_err_to_fd(fd, id, "BAD_CMD", "missing type");
-        cJSON_Delete(root);
+    uwl_proto_cmd_t cmd;
+    if (uwl_proto_parse_cmd(payload, len, &cmd) != ESP_OK) return ESP_ERR_INVALID_ARG;
+
+    const char *type = cmd.type;
+    const int id = uwl_proto_get_int(&cmd, UWL_PROTO_F_ID, -1);
+    const int pin = uwl_proto_get_int(&cmd, UWL_PROTO_F_PIN, -1);
+    if (type[0] == '\0') {
+        uwl_ws_send_err(req, id, "BAD_CMD", "missing type");
         return ESP_ERR_INVALID_ARG;
     }
 
+    char *const buf = s_req_buf;
+    const size_t cap = sizeof(s_req_buf);
+    uwl_proto_writer_t w;
+    uwl_proto_writer_init(&w, buf, cap);
     esp_err_t err = ESP_OK;
 
-    // set (v1/v2)
-    if (strcmp(type, "gpio_set") == 0 || strcmp(type, "s") == 0 || strcmp(type, "set") == 0) {
+    // get: legacy "gpio" frame, then a bare ACK
+    if (uwl_type_is(type, "gpio_get", "g", "get")) {
         if (pin < 0) {
             err = ESP_ERR_INVALID_ARG;
-        } else {
-            err = uwl_io_state_set(pin, (uint8_t)(value ? 1 : 0), UWL_IO_SOURCE_WIFI);
-        }
-        if (err == ESP_OK) {
-            cJSON *data = cJSON_CreateObject();
-            if (data) {
-                cJSON_AddNumberToObject(data, "pin", pin);
-                cJSON_AddNumberToObject(data, "value", value ? 1 : 0);
-            }
-            uwl_ws_send_resp_ok_to_fd(fd, id, data);
-        } else {
-            uwl_ws_send_err_to_fd(fd, id, uwl_err_code_from_esp(err), "gpio_set failed");
-        }
-    }
-    // get (v2 addition for Wi-Fi parity with BLE)
-    else if (strcmp(type, "gpio_get") == 0 || strcmp(type, "g") == 0 || strcmp(type, "get") == 0) {
-        if (pin < 0) {
-            err = ESP_ERR_INVALID_ARG;
-            uwl_ws_send_err_to_fd(fd, id, "BAD_ARG", "missing pin");
+            uwl_ws_send_err(req, id, "BAD_ARG", "missing pin");
         } else {
             uint8_t v = 0;
             err = uwl_io_state_get(pin, &v);
             if (err == ESP_OK) {
-                // Keep legacy "gpio" response too
-                cJSON *o = cJSON_CreateObject();
-                if (o) {
-                    cJSON_AddStringToObject(o, "type", "gpio");
-                    cJSON_AddNumberToObject(o, "pin", pin);
-                    cJSON_AddNumberToObject(o, "value", v ? 1 : 0);
-                    if (id >= 0) cJSON_AddNumberToObject(o, "id", id);
-                    char *s = cJSON_PrintUnformatted(o);
-                    cJSON_Delete(o);
-                    if (s) {
-                        (void)uwl_ws_send_text_to_fd(fd, s);
-                        cJSON_free(s);
-                    }
-                }
-                uwl_ws_send_resp_ok_to_fd(fd, id, NULL);
+                if (uwl_proto_encode_gpio(buf, cap, pin, v, id) > 0) (void)uwl_ws_send_text_req(req, buf);
+                uwl_ws_send_resp_ok(req, id);
             } else {
-                uwl_ws_send_err_to_fd(fd, id, uwl_err_code_from_esp(err), "gpio_get failed");
+                uwl_ws_send_err(req, id, uwl_proto_err_code(err), "gpio_get failed");
             }
         }
     }
+    // push filter: {"t":"sub","m":mask}; without "m" every pin again
+    else if (uwl_type_is(type, "subscribe", "sub", NULL)) {
+        const uint32_t sub = uwl_proto_get_u32(&cmd, UWL_PROTO_F_MASK, UINT32_MAX);
+        err = uwl_ws_sess_set_sub(req, sub);
+        if (err == ESP_OK) {
+            uwl_proto_resp_begin(&w, id, true);
+            uwl_proto_u32(&w, "m", sub);
+            if (uwl_ws_resp_end(&w, true) > 0) (void)uwl_ws_send_text_req(req, buf);
+        } else {
+            uwl_ws_send_err(req, id, uwl_proto_err_code(err), "subscribe failed");
+        }
+    }
+    // several commands, one aggregated resp
+    else if (uwl_type_is(type, "batch", "b", NULL)) {
+        uwl_ws_handle_batch(req, &cmd, id);
+    }
+    // catch up after reconnect: {"t":"sync","b":boot,"s":last_seq}
+    else if (strcmp(type, "sync") == 0) {
+        const int n = uwl_ws_send_catchup(req, uwl_proto_get_u32(&cmd, UWL_PROTO_F_BOOT, 0),
+                                          uwl_proto_get_u32(&cmd, UWL_PROTO_F_SINCE, 0));
+        uwl_proto_resp_begin(&w, id, true);
+        uwl_proto_i64(&w, "n", n < 0 ? 0 : n);
+        uwl_proto_bool(&w, "full", n < 0);
+        if (uwl_ws_resp_end(&w, true) > 0) (void)uwl_ws_send_text_req(req, buf);
+    }
     // list/state -> respond with state snapshot (as before), plus optional ACK
-    else if (strcmp(type, "gpio_list") == 0 || strcmp(type, "l") == 0 || strcmp(type, "list") == 0 ||
-             strcmp(type, "state") == 0) {
-        char *state = uwl_build_state_json();
-        if (state) {
-            (void)uwl_ws_send_text_to_fd(fd, state);
-            cJSON_free(state);
-            uwl_ws_send_resp_ok_to_fd(fd, id, NULL);
+    else if (uwl_type_is(type, "gpio_list", "l", "list") || strcmp(type, "state") == 0) {
+        if (uwl_proto_encode_state(buf, cap) > 0) {
+            (void)uwl_ws_send_text_req(req, buf);
+            uwl_ws_send_resp_ok(req, id);
             err = ESP_OK;
         } else {
             err = ESP_ERR_NO_MEM;
-            uwl_ws_send_err_to_fd(fd, id, "NO_MEM", "no mem");
+            uwl_ws_send_err(req, id, "NO_MEM", "no mem");
         }
     }
+    // set / set_mask / debounce
     else {
-        err = ESP_ERR_NOT_SUPPORTED;
-        uwl_ws_send_err_to_fd(fd, id, "NOT_SUPPORTED", "unknown type");
+        const char *what = NULL;
+        uwl_proto_resp_begin(&w, id, true);
+        err = uwl_ws_exec_cmd(&cmd, &w, &what);
+        if (err == ESP_OK) {
+            if (uwl_ws_resp_end(&w, true) > 0) (void)uwl_ws_send_text_req(req, buf);
+        } else {
+            uwl_ws_send_err(req, id, uwl_proto_err_code(err), what);
+        }
     }
 
-    cJSON_Delete(root);
     return err;
 }
 
-static esp_err_t uwl_ws_handler(httpd_req_t *req)
+// uwl.bin replies to one request frame are packed into as few frames as fit
+static uint8_t s_bin_reply[UWL_PROTO_BIN_HDR_LEN * 32];
+
+static void uwl_ws_bin_flush(httpd_req_t *req, size_t *len)
+{
+    if (*len > 0) (void)uwl_ws_send_frame_req(req, HTTPD_WS_TYPE_BINARY, s_bin_reply, *len);
+    *len = 0;
+}
+
+// Pins addressed by a single-pin op: exactly one mask bit
+static int uwl_ws_bin_one_pin(uint32_t mask)
+{
+    return (mask != 0 && (mask & (mask - 1U)) == 0) ? __builtin_ctz(mask) : -1;
+}
+
+static esp_err_t uwl_ws_handle_binary(httpd_req_t *req, const uint8_t *payload, size_t len)
+{
+    size_t off = 0;
+    size_t out = 0;
+    uwl_proto_bin_rec_t rq;
+    esp_err_t rc;
+
+    while ((rc = uwl_proto_bin_next(payload, len, &off, &rq)) == ESP_OK) {
+        // Keep room for the largest reply (STATE record + RESP)
+        if (sizeof(s_bin_reply) - out < UWL_PROTO_BIN_STATE_LEN + UWL_PROTO_BIN_HDR_LEN) uwl_ws_bin_flush(req, &out);
+
+        uwl_proto_bin_rec_t rsp = { .op = UWL_PROTO_BIN_OP_RESP, .id = rq.id, .mask = rq.mask };
+        const int pin = uwl_ws_bin_one_pin(rq.mask);
+        esp_err_t err = ESP_OK;
+        switch (rq.op) {
+        case UWL_PROTO_BIN_OP_SET:
+            err = pin < 0 ? ESP_ERR_INVALID_ARG
+                          : uwl_io_state_set(pin, (uint8_t)((rq.values >> pin) & 1U), UWL_IO_SOURCE_WIFI);
+            if (err == ESP_OK) uwl_ws_note_gpio_write();
+            rsp.values = rq.values & rq.mask;
+            break;
+        case UWL_PROTO_BIN_OP_SET_MASK:
+            err = uwl_io_state_set_mask(rq.mask, rq.values, UWL_IO_SOURCE_WIFI);
+            if (err == ESP_OK) uwl_ws_note_gpio_write();
+            rsp.values = rq.values & rq.mask;
+            break;
+        case UWL_PROTO_BIN_OP_GET:
+            if (rq.mask == 0) err = ESP_ERR_INVALID_ARG;
+            for (uint32_t m = rq.mask; m && err == ESP_OK; m &= m - 1U) {
+                uint8_t v = 0;
+                err = uwl_io_state_get(__builtin_ctz(m), &v);
+                if (v) rsp.values |= m & -m;
+            }
+            break;
+        case UWL_PROTO_BIN_OP_STATE:
+            out += uwl_proto_bin_put_state(s_bin_reply + out, sizeof(s_bin_reply) - out, rq.id);
+            break;
+        case UWL_PROTO_BIN_OP_DEBOUNCE: {
+            uint32_t window_us = 0;
+            uint8_t count = 0;
+            if (pin < 0 || ((rq.arg & 1U) && rq.seq > 255)) {
+                err = ESP_ERR_INVALID_ARG;
+            } else if (rq.arg & 1U) {
+                err = uwl_io_state_set_debounce(pin, rq.values, (uint8_t)rq.seq);
+            }
+            if (err == ESP_OK) err = uwl_io_state_get_debounce(pin, &window_us, &count);
+            rsp.values = window_us;
+            rsp.seq = count;
+            break;
+        }
+        case UWL_PROTO_BIN_OP_SUB:
+            err = uwl_ws_sess_set_sub(req, rq.mask);
+            break;
+        case UWL_PROTO_BIN_OP_SYNC: {
+            // Replayed records must reach the client before this RESP
+            uwl_ws_bin_flush(req, &out);
+            const int n = uwl_ws_send_catchup(req, rq.values, rq.seq);
+            rsp.arg = n < 0 ? 1 : 0;
+            rsp.values = n < 0 ? 0 : (uint32_t)n;
+            break;
+        }
+        default:
+            err = ESP_ERR_NOT_SUPPORTED;
+            break;
+        }
+
+        if (err != ESP_OK) {
+            rsp = (uwl_proto_bin_rec_t){
+                .op = UWL_PROTO_BIN_OP_ERR,
+                .arg = uwl_proto_bin_err(err),
+                .id = rq.id,
+                .mask = rq.mask,
+            };
+        }
+        out += uwl_proto_bin_put(s_bin_reply + out, sizeof(s_bin_reply) - out, &rsp);
+    }
+
+    if (rc == ESP_ERR_INVALID_SIZE) {
+        const uwl_proto_bin_rec_t bad = { .op = UWL_PROTO_BIN_OP_ERR, .arg = UWL_PROTO_BIN_ERR_BAD_CMD };
+        if (sizeof(s_bin_reply) - out < UWL_PROTO_BIN_HDR_LEN) uwl_ws_bin_flush(req, &out);
+        out += uwl_proto_bin_put(s_bin_reply + out, sizeof(s_bin_reply) - out, &bad);
+    }
+    uwl_ws_bin_flush(req, &out);
+    return rc == ESP_ERR_NOT_FOUND ? ESP_OK : rc;
+}
+
+// True if the handshake offered uwl.bin (httpd already echoed it back)
+static bool uwl_ws_wants_bin(httpd_req_t *req)
+{
+    char protos[64];
+    if (httpd_req_get_hdr_value_str(req, "Sec-WebSocket-Protocol", protos, sizeof(protos)) != ESP_OK) return false;
+    for (char *save = NULL, *tok = strtok_r(protos, ", ", &save); tok; tok = strtok_r(NULL, ", ", &save)) {
+        if (strcmp(tok, UWL_PROTO_BIN_SUBPROTOCOL) == 0) return true;
+    }
+    return false;
+}
+
+// Runs on the httpd task (httpd_queue_work), which owns the keepalive
+// fields. Quiet sessions get a ping; one that stays silent past the idle
+// timeout, pong included, is closed before LRU purge has to evict a live one.
+static void uwl_ws_keepalive_work(void *arg)
 {
-    const int fd = httpd_req_to_sockfd(req);
+    (void)arg;
+    const int64_t now = esp_timer_get_time();
+    const int64_t ping_us = (int64_t)CONFIG_UWL_WS_PING_INTERVAL_S * 1000000;
+    const int64_t idle_us = (int64_t)CONFIG_UWL_WS_IDLE_TIMEOUT_S * 1000000;
 
+    for (size_t i = 0; i < UWL_HTTP_MAX_OPEN_SOCKETS; i++) {
+        uwl_ws_sess_t *sess = &s_sess[i];
+        if (!(sess->gen & 1U) || sess->closing) continue;
+
+        const int64_t idle = now - sess->last_rx_us;
+        if (idle >= idle_us) {
+            ESP_LOGI(TAG, "ws fd=%d idle %" PRId64 " ms, closing", sess->fd, idle / 1000);
+            sess->closing = true;
+            __atomic_fetch_add(&s_keepalive.reaped, 1U, __ATOMIC_RELAXED);
+            (void)httpd_sess_trigger_close(s_server, sess->fd);
+            continue;
+        }
+        if (idle >= ping_us && now - sess->ping_us >= ping_us) {
+            xSemaphoreTake(sess->tx_lock, portMAX_DELAY);
+            const esp_err_t err = uwl_ws_send_frame_to_fd(sess->fd, HTTPD_WS_TYPE_PING, "", 0);
+            xSemaphoreGive(sess->tx_lock);
+            uwl_ws_sess_count_tx(sess, 0, err);
+            sess->ping_us = now;
+            sess->pong_due = err == ESP_OK;
+            if (err == ESP_OK) __atomic_fetch_add(&s_keepalive.pings, 1U, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void uwl_ws_keepalive_timer_cb(void *arg)
+{
+    (void)arg;
+    if (s_server && uwl_ws_get_client_count() > 0) (void)httpd_queue_work(s_server, uwl_ws_keepalive_work, NULL);
+}
+
+// PING / PONG / CLOSE (handle_ws_control_frames): payloads are at most 125 bytes
+static esp_err_t uwl_ws_handle_control(httpd_req_t *req, httpd_ws_frame_t *pkt)
+{
+    uint8_t payload[125];
+    if (pkt->len > sizeof(payload)) return ESP_ERR_INVALID_SIZE;
+    pkt->payload = payload;
+    if (pkt->len > 0) {
+        const esp_err_t err = httpd_ws_recv_frame(req, pkt, pkt->len);
+        if (err != ESP_OK) return err;
+    }
+
+    uwl_ws_sess_t *sess = (uwl_ws_sess_t *)req->sess_ctx;
+    switch (pkt->type) {
+    case HTTPD_WS_TYPE_PING:
+        return uwl_ws_send_frame_req(req, HTTPD_WS_TYPE_PONG, payload, pkt->len);
+    case HTTPD_WS_TYPE_PONG:
+        __atomic_fetch_add(&s_keepalive.pongs, 1U, __ATOMIC_RELAXED);
+        if (sess && sess->pong_due) {
+            sess->rtt_us = (uint32_t)(esp_timer_get_time() - sess->ping_us);
+            sess->pong_due = false;
+        }
+        return ESP_OK;
+    case HTTPD_WS_TYPE_CLOSE:
+        // Echo the status code, then let httpd drop the socket (free_ctx releases the slot)
+        (void)uwl_ws_send_frame_req(req, HTTPD_WS_TYPE_CLOSE, payload, pkt->len >= 2 ? 2 : 0);
+        (void)httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+        return ESP_OK;
+    default:
+        return ESP_OK;
+    }
+}
+
+// Over the client's frame budget: answer with RATE_LIMITED, execute nothing
+static void uwl_ws_reject_rate_limited(httpd_req_t *req, const httpd_ws_frame_t *pkt)
+{
+    uwl_ws_sess_t *sess = (uwl_ws_sess_t *)req->sess_ctx;
+    __atomic_fetch_add(&sess->rate_limited, 1U, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s_rate_limited, 1U, __ATOMIC_RELAXED);
+
+    if (pkt->type == HTTPD_WS_TYPE_BINARY) {
+        size_t off = 0;
+        uwl_proto_bin_rec_t rq = { 0 };
+        (void)uwl_proto_bin_next(pkt->payload, pkt->len, &off, &rq);
+        const uwl_proto_bin_rec_t rsp = {
+            .op = UWL_PROTO_BIN_OP_ERR,
+            .arg = UWL_PROTO_BIN_ERR_RATE_LIMITED,
+            .id = rq.id,
+        };
+        uint8_t out[UWL_PROTO_BIN_HDR_LEN];
+        const size_t n = uwl_proto_bin_put(out, sizeof(out), &rsp);
+        if (n > 0) (void)uwl_ws_send_frame_req(req, HTTPD_WS_TYPE_BINARY, out, n);
+        return;
+    }
+
+    uwl_proto_cmd_t cmd;
+    int id = -1;
+    if (uwl_proto_parse_cmd((const char *)pkt->payload, pkt->len, &cmd) == ESP_OK) {
+        id = uwl_proto_get_int(&cmd, UWL_PROTO_F_ID, -1);
+    }
+    uwl_ws_send_err(req, id, "RATE_LIMITED", "too many frames");
+}
+
+static esp_err_t uwl_ws_handler(httpd_req_t *req)
+{
     if (req->method == HTTP_GET) {
-        uwl_ws_client_add(fd);
+        // httpd stores req->sess_ctx on the session once we return and calls
+        // free_ctx when the socket closes, however that happens
+        uwl_ws_sess_t *sess = uwl_ws_sess_claim(httpd_req_to_sockfd(req), uwl_ws_wants_bin(req));
+        if (!sess) {
+            ESP_LOGW(TAG, "ws session table full");
+            return ESP_FAIL;
+        }
+        req->sess_ctx = sess;
+        req->free_ctx = uwl_ws_sess_release;
 
-        char *state = uwl_build_state_json();
-        if (state) {
-            (void)uwl_ws_send_text_to_fd(fd, state);
-            cJSON_free(state);
+        // /ws?boot=B&since=N: a reconnecting client only needs what it missed
+        char query[64];
+        char val[16];
+        uint32_t boot_id = 0;
+        uint32_t since_seq = 0;
+        if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+            if (httpd_query_key_value(query, "boot", val, sizeof(val)) == ESP_OK) boot_id = strtoul(val, NULL, 10);
+            if (httpd_query_key_value(query, "since", val, sizeof(val)) == ESP_OK) since_seq = strtoul(val, NULL, 10);
         }
+        (void)uwl_ws_send_catchup(req, boot_id, since_seq);
+
+        // The status task only pushes on change; a new client starts with the current one
+        uwl_status_t st;
+        uwl_status_get(&st);
+        char status[UWL_PROTO_SMALL_BUF_LEN];
+        if (uwl_proto_encode_status(status, sizeof(status), &st) > 0) (void)uwl_ws_send_text_req(req, status);
         return ESP_OK;
     }
 
@@ -343,35 +993,49 @@ static esp_err_t uwl_ws_handler(httpd_req_t *req)
     esp_err_t err = httpd_ws_recv_frame(req, &ws_pkt, 0);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "ws recv header failed: %s", esp_err_to_name(err));
-        uwl_ws_client_remove(fd);
         return err;
     }
+    s_rx_us = esp_timer_get_time();
 
-    if (ws_pkt.len == 0) {
-        if (ws_pkt.type == HTTPD_WS_TYPE_CLOSE) {
-            uwl_ws_client_remove(fd);
-        }
-        return ESP_OK;
+    // Any frame proves the peer alive, not just pongs
+    uwl_ws_sess_t *sess = (uwl_ws_sess_t *)req->sess_ctx;
+    if (sess) {
+        __atomic_fetch_add(&sess->rx_frames, 1U, __ATOMIC_RELAXED);
+        sess->last_rx_us = s_rx_us;
     }
+    if (ws_pkt.type == HTTPD_WS_TYPE_PING || ws_pkt.type == HTTPD_WS_TYPE_PONG || ws_pkt.type == HTTPD_WS_TYPE_CLOSE) {
+        return uwl_ws_handle_control(req, &ws_pkt);
+    }
+    if (ws_pkt.len == 0) return ESP_OK;
 
-    char *buf = (char *)calloc(1, ws_pkt.len + 1);
-    if (!buf) return ESP_ERR_NO_MEM;
+    // The length is client-supplied: refuse before reading a byte of payload.
+    // 1009 = message too big; returning an error makes httpd drop the socket.
+    if (ws_pkt.len > CONFIG_UWL_WS_MAX_FRAME_LEN) {
+        ESP_LOGW(TAG, "ws fd=%d frame of %u bytes exceeds %u, closing", httpd_req_to_sockfd(req),
+                 (unsigned)ws_pkt.len, (unsigned)CONFIG_UWL_WS_MAX_FRAME_LEN);
+        static const uint8_t too_big[2] = { 0x03, 0xF1 };
+        (void)uwl_ws_send_frame_req(req, HTTPD_WS_TYPE_CLOSE, too_big, sizeof(too_big));
+        return ESP_ERR_INVALID_SIZE;
+    }
 
+    char *const buf = s_rx_buf;
     ws_pkt.payload = (uint8_t *)buf;
     err = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
-    if (err == ESP_OK) {
-        buf[ws_pkt.len] = '\0';
-        if (ws_pkt.type == HTTPD_WS_TYPE_TEXT) {
-            (void)uwl_ws_handle_message(req, buf, ws_pkt.len);
-        } else if (ws_pkt.type == HTTPD_WS_TYPE_CLOSE) {
-            uwl_ws_client_remove(fd);
-        }
-    } else {
+    if (err != ESP_OK) {
         ESP_LOGW(TAG, "ws recv payload failed: %s", esp_err_to_name(err));
-        uwl_ws_client_remove(fd);
+        return err;
     }
 
-    free(buf);
+    buf[ws_pkt.len] = '\0';
+    if (sess && !uwl_rate_take(&sess->rx_rate, sess->last_rx_us)) {
+        uwl_ws_reject_rate_limited(req, &ws_pkt);
+    } else if (ws_pkt.type == HTTPD_WS_TYPE_TEXT) {
+        (void)uwl_ws_handle_message(req, buf, ws_pkt.len);
+        uwl_lat_record_since(UWL_IO_SOURCE_WIFI, UWL_LAT_ACK, s_rx_us);
+    } else if (ws_pkt.type == HTTPD_WS_TYPE_BINARY) {
+        (void)uwl_ws_handle_binary(req, (const uint8_t *)buf, ws_pkt.len);
+        uwl_lat_record_since(UWL_IO_SOURCE_WIFI, UWL_LAT_ACK, s_rx_us);
+    }
     return ESP_OK;
 }
 
@@ -379,26 +1043,46 @@ esp_err_t uwl_ws_register(httpd_handle_t server)
 {
     if (!server) return ESP_ERR_INVALID_ARG;
     s_server = server;
-    if (!s_clients_lock) {
-        s_clients_lock = xSemaphoreCreateMutex();
+
+    for (size_t i = 0; i < UWL_HTTP_MAX_OPEN_SOCKETS; i++) {
+        if (s_sess[i].tx_lock) continue;
+        s_sess[i].tx_lock = xSemaphoreCreateMutex();
+        if (!s_sess[i].tx_lock) return ESP_ERR_NO_MEM;
     }
 
     // Register event listener once (idempotent enough for this app)
-    (void)uwl_io_state_add_listener(uwl_ws_on_io_event, NULL);
+    const uwl_io_listener_cfg_t lcfg = {
+        .name = "uwl_ws_tx",
+        .batch_fn = uwl_ws_on_io_batch,
+        .policy = UWL_IO_OVERFLOW_COALESCE,
+    };
+    (void)uwl_io_state_add_listener_ex(&lcfg);
 
     if (!s_status_task_started) {
         s_status_task_started = true;
         xTaskCreate(uwl_ws_status_task, "uwl_ws_stat", 3072, NULL, 6, NULL);
     }
 
+    if (CONFIG_UWL_WS_PING_INTERVAL_S > 0 && !s_keepalive_timer) {
+        const esp_timer_create_args_t targs = {
+            .callback = uwl_ws_keepalive_timer_cb,
+            .name = "uwl_ws_ka",
+        };
+        if (esp_timer_create(&targs, &s_keepalive_timer) == ESP_OK) {
+            (void)esp_timer_start_periodic(s_keepalive_timer, (uint64_t)UWL_WS_SWEEP_S * 1000000ULL);
+        }
+    }
+
     httpd_uri_t ws = {
         .uri = "/ws",
         .method = HTTP_GET,
         .handler = uwl_ws_handler,
         .user_ctx = NULL,
         .is_websocket = true,
-        .handle_ws_control_frames = false,
-        .supported_subprotocol = NULL,
+        // PING/PONG/CLOSE reach uwl_ws_handler: pongs feed the keepalive
+        .handle_ws_control_frames = true,
+        // JSON-only clients that do not offer it still connect
+        .supported_subprotocol = UWL_PROTO_BIN_SUBPROTOCOL,
     };
 
     return httpd_register_uri_handler(server, &ws);
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "esp_err.h"
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "esp_http_server.h"
 
@@ -9,8 +11,41 @@
 extern "C" {
 #endif
 
+typedef struct {
+    int fd;
+    bool bin;           // uwl.bin subprotocol
+    uint32_t sub;       // push subscription mask
+    int64_t opened_us;  // handshake time (esp_timer)
+    uint32_t rx_frames;
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    uint32_t tx_errors;
+    uint32_t idle_ms;   // since the last frame from the client
+    uint32_t rtt_us;    // last keepalive ping -> pong, 0 if none yet
+    uint32_t rate_limited; // frames refused by the per-client token bucket
+} uwl_ws_session_stats_t;
+
+typedef struct {
+    uint32_t pings;  // keepalive pings sent
+    uint32_t pongs;  // pongs received
+    uint32_t reaped; // sessions closed after UWL_WS_IDLE_TIMEOUT_S without a frame
+} uwl_ws_keepalive_stats_t;
+
+// All sessions since boot, closed ones included
+typedef struct {
+    uint32_t frames; // frames handed to the socket
+    uint32_t bytes;
+    uint32_t errors; // sends that failed
+} uwl_ws_tx_stats_t;
+
 esp_err_t uwl_ws_register(httpd_handle_t server);
 size_t uwl_ws_get_client_count(void);
+// One entry per open WebSocket session; returns the number written
+size_t uwl_ws_get_session_stats(uwl_ws_session_stats_t *out, size_t cap);
+void uwl_ws_get_keepalive_stats(uwl_ws_keepalive_stats_t *out);
+void uwl_ws_get_tx_stats(uwl_ws_tx_stats_t *out);
+// Frames refused by per-client rate limits, all sessions since boot
+uint32_t uwl_ws_get_rate_limited(void);
 
 #ifdef __cplusplus
 }
@@ -4,9 +4,36 @@ const WS_URL = `ws://${location.host || "192.168.4.1"}/ws`;
 const API_STATUS_URL = `${location.origin}/api/status`;
 
 let ws = null;
-const gpioMap = new Map(); // pin -> {pin,dir,value}
+const gpioMap = new Map(); // pin -> {pin,dir,value,seq}
 let wsSeq = 1;
 
+// Event stream position: lets a reconnect ask for only the missed events
+let evtBoot = null;
+let lastSeq = 0;
+
+function seqAfter(a, b) {
+  return ((a - b) | 0) > 0;
+}
+
+function noteSeq(seq) {
+  if (typeof seq === "number" && seqAfter(seq, lastSeq)) lastSeq = seq >>> 0;
+}
+
+// uwl.bin (see main/uwl_proto.h): 16-byte little-endian records, used for the
+// hot path (set/get and change pushes) when the server accepts the subprotocol
+const WS_BIN_PROTO = "uwl.bin";
+const BIN = { SET: 0x01, SET_MASK: 0x02, GET: 0x03, RESP: 0x80, ERR: 0x81, CHANGED: 0x90, MODE: 0x91, STATE: 0x92 };
+const BIN_ERR = ["", "NOT_FOUND", "NOT_OUTPUT", "BAD_ARG", "NO_MEM", "NOT_SUPPORTED", "FAIL", "BAD_CMD", "RATE_LIMITED"];
+const binPending = new Map(); // id -> op, to apply GET replies
+
+function wsBin() {
+  return !!ws && ws.protocol === WS_BIN_PROTO;
+}
+
+function wsUrl() {
+  return evtBoot === null ? WS_URL : `${WS_URL}?boot=${evtBoot}&since=${lastSeq}`;
+}
+
 // BLE (Web Bluetooth)
 const BLE_UUIDS = {
   // Must match main/uwl_ble_gatt.c
@@ -102,6 +129,7 @@ function loadCfg() {
 }
 function saveCfg(cfg) {
   localStorage.setItem(CFG_KEY, JSON.stringify(cfg || {}));
+  sendSub();
 }
 let pinCfg = loadCfg(); // { [pin:number]: {label, role} }
 
@@ -115,6 +143,33 @@ function isPinEnabled(pin) {
   return !!cfg.enabled;
 }
 
+// Push filter: the control page only shows enabled pins, so only ask for those
+function subMask() {
+  if (!document.body.classList.contains("page--control")) return 0xffffffff;
+  let m = 0;
+  for (let pin = 0; pin < 32; pin++) {
+    if (isPinEnabled(pin)) m |= 1 << pin;
+  }
+  return m >>> 0;
+}
+
+// Mask the device was last told; the server starts every session at all pins
+let subSent = 0xffffffff;
+
+function sendSub() {
+  const m = subMask();
+  // Pins outside the old mask got no pushes, so their values are stale
+  const widened = (m & ~subSent) >>> 0;
+  subSent = m;
+  if (ws && ws.readyState === WebSocket.OPEN) {
+    ws.send(JSON.stringify({ t: "sub", m, i: wsSeq++ }));
+    if (widened) send({ type: "state" });
+  }
+  if (bleIsConnected()) {
+    void bleWrite({ t: "sub", m }).then(() => (widened ? bleReadState() : undefined)).catch(() => {});
+  }
+}
+
 function render() {
   const list = document.getElementById("gpioList");
   if (!list) return;
@@ -138,7 +193,7 @@ function render() {
 
     const sub = document.createElement("div");
     sub.className = "item__sub";
-    sub.textContent = `dir=${g.dir}, value=${g.value}`;
+    sub.textContent = `dir=${g.dir}, value=${g.value}` + (g.mode === "poll" ? "（中断风暴，轮询中）" : "");
 
     meta.appendChild(pinEl);
     meta.appendChild(sub);
@@ -296,28 +351,142 @@ function renderHeaders() {
   renderOne(hdrJ3, "J3", HEADER_PINS.J3);
 }
 
+function applySnapshotPos(msg) {
+  // A snapshot resets the stream position (also after a device reboot)
+  if (typeof msg.boot === "number") evtBoot = msg.boot >>> 0;
+  if (typeof msg.seq === "number") lastSeq = msg.seq >>> 0;
+}
+
 function applyState(msg) {
+  applySnapshotPos(msg);
   if (Array.isArray(msg.gpios)) {
     for (const g of msg.gpios) {
-      gpioMap.set(g.pin, { pin: g.pin, dir: g.dir, value: g.value });
+      gpioMap.set(g.pin, { pin: g.pin, dir: g.dir, value: g.value, mode: g.mode, seq: lastSeq });
     }
     render();
     renderHeaders();
   }
 }
 
+function applyResync(msg) {
+  // Bitmask snapshot (BLE): bit N of mask/out/values describes GPIO N
+  if (typeof msg.mask !== "number" || typeof msg.values !== "number") return;
+  applySnapshotPos(msg);
+  for (let pin = 0; pin < 32; pin++) {
+    if (!((msg.mask >>> pin) & 1)) continue;
+    const dir = typeof msg.out === "number" ? (((msg.out >>> pin) & 1) ? "out" : "in") : undefined;
+    const prev = gpioMap.get(pin) || { pin, dir: dir || "in", value: 0 };
+    gpioMap.set(pin, { ...prev, dir: dir || prev.dir, value: (msg.values >>> pin) & 1, seq: lastSeq });
+  }
+  render();
+  renderHeaders();
+}
+
+function applyMode(msg) {
+  // Storm guard: {"type":"gpio_mode","pin":10,"mode":"poll"|"irq","rate":edges_per_s}
+  if (typeof msg.pin !== "number") return;
+  noteSeq(msg.seq);
+  const prev = gpioMap.get(msg.pin) || { pin: msg.pin, dir: "in", value: 0 };
+  gpioMap.set(msg.pin, { ...prev, mode: msg.mode });
+  render();
+}
+
+function applyPinChange(pin, dir, value, seq) {
+  const prev = gpioMap.get(pin) || { pin, dir: dir || "in", value: 0 };
+  // Catch-up replay can overlap live events: never let an older one win
+  if (typeof seq === "number" && typeof prev.seq === "number" && !seqAfter(seq, prev.seq)) return;
+  noteSeq(seq);
+  gpioMap.set(pin, { ...prev, dir: dir || prev.dir, value: value ? 1 : 0, seq: typeof seq === "number" ? seq >>> 0 : prev.seq });
+}
+
 function applyChanged(msg) {
+  // Coalesced multi-pin write: {"type":"gpio_changed","changes":[{pin,value,dir},...]}
+  if (Array.isArray(msg.changes)) {
+    for (const c of msg.changes) {
+      if (typeof c.pin !== "number") continue;
+      applyPinChange(c.pin, c.dir, c.value, typeof c.seq === "number" ? c.seq : msg.seq);
+    }
+    render();
+    renderHeaders();
+    return;
+  }
   if (typeof msg.pin !== "number") return;
-  const prev = gpioMap.get(msg.pin) || { pin: msg.pin, dir: msg.dir || "in", value: 0 };
-  gpioMap.set(msg.pin, { ...prev, dir: msg.dir || prev.dir, value: msg.value ? 1 : 0 });
+  applyPinChange(msg.pin, msg.dir, msg.value, msg.seq);
   render();
   renderHeaders();
 }
 
+function binRecord(op, id, mask, values) {
+  const buf = new ArrayBuffer(16);
+  const v = new DataView(buf);
+  v.setUint8(0, op);
+  v.setUint16(2, id & 0xffff, true);
+  v.setUint32(4, mask >>> 0, true);
+  v.setUint32(8, values >>> 0, true);
+  return buf;
+}
+
+function sendBin(obj) {
+  const id = wsSeq++ & 0xffff;
+  let rec = null;
+  if (obj.type === "gpio_set") rec = binRecord(BIN.SET, id, 1 << obj.pin, obj.value ? 1 << obj.pin : 0);
+  else if (obj.type === "gpio_set_mask") rec = binRecord(BIN.SET_MASK, id, obj.mask, obj.values);
+  else if (obj.type === "gpio_get") rec = binRecord(BIN.GET, id, 1 << obj.pin, 0);
+  if (!rec) return false;
+  if (obj.type === "gpio_get") binPending.set(id, BIN.GET);
+  ws.send(rec);
+  return true;
+}
+
+function handleBinMessage(buf) {
+  const v = new DataView(buf);
+  let dirty = false;
+  for (let off = 0; off + 16 <= v.byteLength; ) {
+    const op = v.getUint8(off);
+    const arg = v.getUint8(off + 1);
+    const id = v.getUint16(off + 2, true);
+    const mask = v.getUint32(off + 4, true);
+    const values = v.getUint32(off + 8, true);
+    const seq = v.getUint32(off + 12, true);
+    if (op === BIN.CHANGED) {
+      for (let pin = 0; pin < 32; pin++) {
+        if ((mask >>> pin) & 1) applyPinChange(pin, undefined, (values >>> pin) & 1, seq);
+      }
+      dirty = true;
+      off += 24;
+    } else if (op === BIN.MODE) {
+      applyMode({ pin: 31 - Math.clz32(mask), mode: arg ? "poll" : "irq", seq });
+      off += 24;
+    } else if (op === BIN.STATE) {
+      applyResync({ boot: v.getUint32(off + 24, true), seq, mask, out: v.getUint32(off + 16, true), values });
+      off += 32;
+    } else {
+      const reqOp = binPending.get(id);
+      binPending.delete(id);
+      if (op === BIN.RESP && reqOp === BIN.GET) {
+        for (let pin = 0; pin < 32; pin++) {
+          if ((mask >>> pin) & 1) applyPinChange(pin, undefined, (values >>> pin) & 1);
+        }
+        dirty = true;
+      } else if (op === BIN.ERR) {
+        // eslint-disable-next-line no-console
+        console.warn("WS err:", BIN_ERR[arg] || arg, "id", id);
+      }
+      off += 16;
+    }
+  }
+  if (dirty) {
+    render();
+    renderHeaders();
+  }
+}
+
 function send(obj) {
   if (!ws || ws.readyState !== WebSocket.OPEN) return;
+  if (wsBin() && obj && typeof obj.type === "string" && sendBin(obj)) return;
   // Keep Wi‑Fi WS command format aligned with BLE:
   // gpio_set -> {"t":"s","p":X,"v":0|1,"i":id}
+  // gpio_set_mask -> {"t":"m","m":mask,"v":values,"i":id}
   // gpio_get -> {"t":"g","p":X,"i":id}
   // state    -> {"t":"state","i":id}
   // gpio_list-> {"t":"l","i":id}
@@ -325,6 +494,7 @@ function send(obj) {
   if (obj && typeof obj === "object" && typeof obj.type === "string") {
     const id = wsSeq++;
     if (obj.type === "gpio_set") payload = { t: "s", p: obj.pin, v: obj.value ? 1 : 0, i: id };
+    else if (obj.type === "gpio_set_mask") payload = { t: "m", m: obj.mask >>> 0, v: obj.values >>> 0, i: id };
     else if (obj.type === "gpio_get") payload = { t: "g", p: obj.pin, i: id };
     else if (obj.type === "state") payload = { t: "state", i: id };
     else if (obj.type === "gpio_list") payload = { t: "l", i: id };
@@ -391,6 +561,7 @@ async function bleWrite(obj) {
   if (obj && typeof obj === "object" && typeof obj.type === "string") {
     const id = ble.seq++;
     if (obj.type === "gpio_set") payload = { t: "s", p: obj.pin, v: obj.value ? 1 : 0, i: id };
+    else if (obj.type === "gpio_set_mask") payload = { t: "m", m: obj.mask >>> 0, v: obj.values >>> 0, i: id };
     else if (obj.type === "gpio_get") payload = { t: "g", p: obj.pin, i: id };
     else if (obj.type === "state") payload = { t: "state", i: id };
     else if (obj.type === "gpio_list") payload = { t: "l", i: id };
@@ -410,6 +581,8 @@ function handleJsonMessage(msg) {
   if (!msg || typeof msg.type !== "string") return;
   if (msg.type === "state") applyState(msg);
   else if (msg.type === "gpio_changed") applyChanged(msg);
+  else if (msg.type === "resync") applyResync(msg);
+  else if (msg.type === "gpio_mode") applyMode(msg);
   else if (msg.type === "gpio") applyChanged({ type: "gpio_changed", pin: msg.pin, value: msg.value, dir: "in" });
   else if (msg.type === "resp") {
     // eslint-disable-next-line no-console
@@ -491,7 +664,10 @@ async function bleConnect() {
 
     setBleConn(true, `BLE: 已连接(${device.name || "device"})`);
     setBleButtons(true);
-    await bleReadState();
+    subSent = subMask();
+    await bleWrite({ t: "sub", m: subSent });
+    if (evtBoot !== null) await bleWrite({ t: "sync", b: evtBoot, s: lastSeq });
+    else await bleReadState();
   } catch (e) {
     setBleConn(false, "BLE: 连接失败");
     setBleButtons(false);
@@ -511,11 +687,16 @@ function bleDisconnect() {
 
 function connect() {
   setConn(false, "WS: 连接中…");
-  ws = new WebSocket(WS_URL);
+  // The server answers the handshake with the missed events, or a full state
+  // Offer uwl.bin; ws.protocol stays empty if the server only speaks JSON
+  ws = new WebSocket(wsUrl(), [WS_BIN_PROTO]);
+  ws.binaryType = "arraybuffer";
+  binPending.clear();
 
   ws.onopen = () => {
     setConn(true, "WS: 已连接");
-    send({ type: "state" });
+    subSent = 0xffffffff; // the handshake reply already carries every pin
+    sendSub();
   };
 
   ws.onclose = () => {
@@ -529,6 +710,10 @@ function connect() {
 
   ws.onmessage = (ev) => {
     try {
+      if (ev.data instanceof ArrayBuffer) {
+        handleBinMessage(ev.data);
+        return;
+      }
       const msg = JSON.parse(ev.data);
       handleJsonMessage(msg);
     } catch (_) {